@@ -0,0 +1,394 @@
+#include <jigsaw/sketch.hpp>
+#include <jigsaw/sketch_types.hpp>
+#include <jigsaw/trace_reader.hpp>
+#include <jigsaw/tokenizer.hpp>
+#include <jigsaw/utils/mapped_file.hpp>
+#include "workload.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Accuracy against throughput for the sketch configurations: every dataset
+// is loaded into memory and counted exactly, then replayed through each
+// configuration. One row per (dataset, configuration) goes to stdout as CSV
+// or JSON, so the fastest configuration that meets an accuracy target can be
+// picked by a script.
+//
+// Columns: memory is Sketch::MEMORY_SIZE; mpps is the best of --repeat
+// timed replays (insert_batch only, the data is already decoded); precision
+// and recall compare top_k(k) with the exact k largest flows (ties at the
+// k-th count included); are/aae are the relative and absolute errors of
+// query() over those exact k flows.
+//
+// caida/bytes replays the traces again with byte weights (insert with a
+// weight per packet) and compares against exact byte totals. The .dat
+// records carry no lengths, so each packet gets workload::packet_bytes.
+
+namespace {
+
+// Exact counts are keyed on a key's SIZE meaningful bytes
+template<typename KeyType>
+struct KeyBytesHash {
+    size_t operator()(const KeyType& key) const {
+        return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(&key), KeyType::SIZE));
+    }
+};
+
+template<typename KeyType>
+struct KeyBytesEqual {
+    bool operator()(const KeyType& a, const KeyType& b) const {
+        return memcmp(&a, &b, KeyType::SIZE) == 0;
+    }
+};
+
+template<typename KeyType>
+using KeyCounts = std::unordered_map<KeyType, uint64_t, KeyBytesHash<KeyType>, KeyBytesEqual<KeyType>>;
+
+template<typename KeyType>
+using KeySet = std::unordered_set<KeyType, KeyBytesHash<KeyType>, KeyBytesEqual<KeyType>>;
+
+template<typename KeyType>
+struct Dataset {
+    std::string name;
+    std::vector<KeyType> keys;
+    std::vector<uint32_t> weights;  // per key, or empty for unit counts
+    KeyCounts<KeyType> counts;
+};
+
+struct Options {
+    std::string data_dir = "../data/";
+    bool json = false;
+    size_t k = 100;
+    size_t repeat = 3;
+    size_t max_items = 10'000'000;
+};
+
+struct Result {
+    std::string dataset;
+    std::string config;
+    const char* layout;
+    uint32_t bucket_num;
+    uint32_t cell_num_h;
+    uint32_t cell_num_l;
+    uint32_t left_part_bits;
+    bool exact_keys;
+    uint64_t memory;
+    size_t items;
+    size_t flows;
+    double mpps;
+    size_t k;
+    double precision;
+    double recall;
+    double are;
+    double aae;
+};
+
+template<typename Layout>
+const char* layout_name() {
+    // The low byte names the layout; PackedLayout keeps its widths above it
+    switch (Layout::FORMAT_ID & 0xFF) {
+        case jigsaw::AoSLayout::FORMAT_ID: return "AoS";
+        case jigsaw::SoALayout::FORMAT_ID: return "SoA";
+        case jigsaw::PaddedSoALayout::FORMAT_ID: return "PaddedSoA";
+        case jigsaw::ColocatedLayout::FORMAT_ID: return "Colocated";
+        case jigsaw::PackedLayout<>::FORMAT_ID & 0xFF: return "Packed";
+        default: return "unknown";
+    }
+}
+
+// Template parameters of a Sketch type
+template<typename SketchType>
+struct SketchParams;
+
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout, typename Rng>
+struct SketchParams<jigsaw::Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout, Rng>> {
+    using SketchType = jigsaw::Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout, Rng>;
+    static constexpr uint32_t BUCKET_NUM = BucketNum;
+    static constexpr uint32_t LEFT_PART_BITS = LeftPartBits;
+    static constexpr uint32_t CELL_NUM_H = CellNumH;
+    static constexpr uint32_t CELL_NUM_L = CellNumL;
+
+    static const char* layout() { return layout_name<Layout>(); }
+
+    // The key as the sketch reports it: split, left part cut to the stored
+    // bits, joined again. The identity when the sketch keeps exact keys.
+    static KeyType stored_key(const KeyType& key) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+        for (uint32_t i = 0; i < SketchType::LEFT_PART_WORDS; i++) {
+            const uint32_t low = 64 * i;
+            if (LeftPartBits <= low) {
+                left_part[i] = 0;
+            } else if (LeftPartBits - low < 64) {
+                left_part[i] &= (uint64_t(1) << (LeftPartBits - low)) - 1;
+            }
+        }
+        KeyType stored{};
+        jigsaw::KeyHasher<KeyType, BucketNum>::combine_key(stored, bucket_idx, fp, left_part);
+        return stored;
+    }
+};
+
+template<typename SketchType, typename KeyType>
+Result evaluate(const char* config, const Dataset<KeyType>& data, const Options& options) {
+    using Params = SketchParams<SketchType>;
+    constexpr size_t batch_size = 1 << 14;
+
+    std::unique_ptr<SketchType> sketch;
+    double best_seconds = 0;
+    for (size_t run = 0; run < std::max<size_t>(options.repeat, 1); run++) {
+        sketch = std::make_unique<SketchType>(run + 1);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t base = 0; base < data.keys.size(); base += batch_size) {
+            const size_t n = std::min(batch_size, data.keys.size() - base);
+            if (data.weights.empty()) {
+                sketch->insert_batch(data.keys.data() + base, n);
+            } else {
+                sketch->insert_batch(data.keys.data() + base, data.weights.data() + base, n);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < best_seconds) {
+            best_seconds = seconds;
+        }
+    }
+
+    std::vector<std::pair<KeyType, uint64_t>> exact(data.counts.begin(), data.counts.end());
+    const size_t k = std::min(options.k, exact.size());
+    std::partial_sort(exact.begin(), exact.begin() + k, exact.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+    exact.resize(k);
+
+    // Flows tied with the k-th largest count are as correct an answer
+    KeySet<KeyType> expected;
+    if (k > 0) {
+        for (const auto& [key, count] : data.counts) {
+            if (count >= exact.back().second) {
+                expected.insert(Params::stored_key(key));
+            }
+        }
+    }
+
+    double relative_error = 0;
+    double absolute_error = 0;
+    for (const auto& [key, count] : exact) {
+        double error = std::abs(double(sketch->query(key)) - double(count));
+        absolute_error += error;
+        relative_error += error / double(count);
+    }
+
+    size_t hits = 0;
+    const auto reported = sketch->top_k(k);
+    for (const auto& flow : reported) {
+        hits += expected.count(flow.key);
+    }
+
+    Result result;
+    result.dataset = data.name;
+    result.config = config;
+    result.layout = Params::layout();
+    result.bucket_num = Params::BUCKET_NUM;
+    result.cell_num_h = Params::CELL_NUM_H;
+    result.cell_num_l = Params::CELL_NUM_L;
+    result.left_part_bits = Params::LEFT_PART_BITS;
+    result.exact_keys = SketchType::EXACT_KEYS;
+    result.memory = SketchType::MEMORY_SIZE;
+    result.items = data.keys.size();
+    result.flows = data.counts.size();
+    result.mpps = best_seconds > 0 ? data.keys.size() / best_seconds / 1e6 : 0;
+    result.k = k;
+    result.precision = reported.empty() ? 0 : double(hits) / reported.size();
+    result.recall = k == 0 ? 0 : std::min(1.0, double(hits) / k);
+    result.are = k == 0 ? 0 : relative_error / k;
+    result.aae = k == 0 ? 0 : absolute_error / k;
+    return result;
+}
+
+template<typename KeyType>
+void count_exact(Dataset<KeyType>& data) {
+    data.counts.clear();
+    data.counts.reserve(data.keys.size() / 4);
+    for (size_t i = 0; i < data.keys.size(); i++) {
+        data.counts[data.keys[i]] += data.weights.empty() ? 1 : data.weights[i];
+    }
+}
+
+// 0.dat .. 10.dat that exist under data_dir, up to max_items records
+bool load_traces(const Options& options, Dataset<jigsaw::IPv4Flow>& data) {
+    std::vector<std::string> paths;
+    for (int file_num = 0; file_num <= 10; ++file_num) {
+        std::string path = options.data_dir + std::to_string(file_num) + ".dat";
+        if (std::ifstream(path).good()) {
+            paths.push_back(path);
+        }
+    }
+    if (paths.empty()) {
+        return false;
+    }
+    data.name = "caida";
+    jigsaw::replay_traces(paths, [&](const jigsaw::IPv4Flow* flows, size_t n) {
+        data.keys.insert(data.keys.end(), flows, flows + n);
+    }, 1 << 14, options.max_items);
+    count_exact(data);
+    return true;
+}
+
+// Whitespace-separated words, as word_count splits them
+bool load_words(const Options& options, Dataset<jigsaw::CompactStringKey>& data) {
+    const std::string path = options.data_dir + "war_and_peace.txt";
+    if (!std::ifstream(path).good()) {
+        return false;
+    }
+    jigsaw::MappedFile file(path);
+
+    data.name = "war_and_peace";
+    jigsaw::tokenize_words(file.data(), file.size(), [&](const jigsaw::CompactStringKey* keys, size_t n) {
+        data.keys.insert(data.keys.end(), keys, keys + std::min(n, options.max_items - data.keys.size()));
+    });
+    count_exact(data);
+    return true;
+}
+
+void print_csv(const std::vector<Result>& results) {
+    std::printf("dataset,config,layout,bucket_num,cell_num_h,cell_num_l,left_part_bits,exact_keys,"
+                "memory_bytes,items,flows,mpps,k,precision,recall,are,aae\n");
+    for (const auto& r : results) {
+        std::printf("%s,%s,%s,%u,%u,%u,%u,%d,%llu,%zu,%zu,%.3f,%zu,%.4f,%.4f,%.6f,%.3f\n",
+                    r.dataset.c_str(), r.config.c_str(), r.layout, r.bucket_num, r.cell_num_h, r.cell_num_l,
+                    r.left_part_bits, r.exact_keys ? 1 : 0, static_cast<unsigned long long>(r.memory), r.items,
+                    r.flows, r.mpps, r.k, r.precision, r.recall, r.are, r.aae);
+    }
+}
+
+void print_json(const std::vector<Result>& results) {
+    std::printf("[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        std::printf("  {\"dataset\": \"%s\", \"config\": \"%s\", \"layout\": \"%s\", \"bucket_num\": %u, "
+                    "\"cell_num_h\": %u, \"cell_num_l\": %u, \"left_part_bits\": %u, \"exact_keys\": %s, "
+                    "\"memory_bytes\": %llu, \"items\": %zu, \"flows\": %zu, \"mpps\": %.3f, \"k\": %zu, "
+                    "\"precision\": %.4f, \"recall\": %.4f, \"are\": %.6f, \"aae\": %.3f}%s\n",
+                    r.dataset.c_str(), r.config.c_str(), r.layout, r.bucket_num, r.cell_num_h, r.cell_num_l,
+                    r.left_part_bits, r.exact_keys ? "true" : "false", static_cast<unsigned long long>(r.memory),
+                    r.items, r.flows, r.mpps, r.k, r.precision, r.recall, r.are, r.aae,
+                    i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            }
+            return argv[++i];
+        };
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--data") {
+            options.data_dir = value();
+            if (!options.data_dir.empty() && options.data_dir.back() != '/') {
+                options.data_dir += '/';
+            }
+        } else if (arg == "--k") {
+            options.k = std::stoul(value());
+        } else if (arg == "--repeat") {
+            options.repeat = std::stoul(value());
+        } else if (arg == "--max-items") {
+            options.max_items = std::stoul(value());
+        } else {
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+// Usage: sketch_accuracy [--data DIR] [--k N] [--repeat N] [--max-items N] [--json]
+//   --data       directory holding 0.dat .. 10.dat and war_and_peace.txt (../data/)
+//   --k          size of the top-k compared against the exact counts (100)
+//   --repeat     timed replays per configuration; the fastest is reported (3)
+//   --max-items  items loaded per dataset (10000000)
+//   --json       JSON array instead of CSV
+int main(int argc, char** argv) {
+    using namespace jigsaw;
+    try {
+        const Options options = parse_options(argc, argv);
+        std::vector<Result> results;
+
+        Dataset<IPv4Flow> traces;
+        if (load_traces(options, traces)) {
+            std::cerr << "caida: " << traces.keys.size() << " items, " << traces.counts.size() << " flows\n";
+            constexpr uint32_t EXACT_BITS = KeyHasher<IPv4Flow, 4096>::LEFT_PART_BITS;
+            results.push_back(evaluate<SmallSketch>("SmallSketch", traces, options));
+            results.push_back(evaluate<MediumSketch>("MediumSketch", traces, options));
+            results.push_back(evaluate<LargeSketch>("LargeSketch", traces, options));
+            results.push_back(evaluate<MediumSoASketch>("MediumSoASketch", traces, options));
+            results.push_back(evaluate<LargeSoASketch>("LargeSoASketch", traces, options));
+            results.push_back(evaluate<MediumPaddedSketch>("MediumPaddedSketch", traces, options));
+            results.push_back(evaluate<LargePaddedSketch>("LargePaddedSketch", traces, options));
+            results.push_back(evaluate<MediumColocatedSketch>("MediumColocatedSketch", traces, options));
+            results.push_back(evaluate<LargeColocatedSketch>("LargeColocatedSketch", traces, options));
+            results.push_back(evaluate<MediumPackedSketch>("MediumPackedSketch", traces, options));
+            results.push_back(evaluate<LargePackedSketch>("LargePackedSketch", traces, options));
+            // Left parts wide enough to report exact 5-tuples
+            results.push_back(evaluate<Sketch<IPv4Flow, 4096, EXACT_BITS, 16, 16>>("MediumSketch/exact", traces, options));
+            results.push_back(evaluate<Sketch<IPv4Flow, 16384, EXACT_BITS, 32, 32, ColocatedLayout>>(
+                "LargeColocatedSketch/exact", traces, options));
+
+            // The same packets weighted by their length
+            traces.name = "caida/bytes";
+            traces.weights = workload::packet_sizes(traces.keys);
+            count_exact(traces);
+            results.push_back(evaluate<SmallSketch>("SmallSketch", traces, options));
+            results.push_back(evaluate<MediumSketch>("MediumSketch", traces, options));
+            results.push_back(evaluate<LargeSketch>("LargeSketch", traces, options));
+            results.push_back(evaluate<LargeColocatedSketch>("LargeColocatedSketch", traces, options));
+        } else {
+            std::cerr << "no traces under " << options.data_dir << ", skipping caida\n";
+        }
+
+        Dataset<CompactStringKey> words;
+        if (load_words(options, words)) {
+            std::cerr << "war_and_peace: " << words.keys.size() << " words, " << words.counts.size() << " distinct\n";
+            results.push_back(evaluate<WordSketch>("WordSketch", words, options));
+            results.push_back(evaluate<LargeWordSketch>("LargeWordSketch", words, options));
+            results.push_back(evaluate<Sketch<CompactStringKey, 1024, 104, 8, 8, SoALayout>>(
+                "WordSketch/SoA", words, options));
+            results.push_back(evaluate<Sketch<CompactStringKey, 4096, 104, 16, 16, ColocatedLayout>>(
+                "LargeWordSketch/Colocated", words, options));
+        } else {
+            std::cerr << "no war_and_peace.txt under " << options.data_dir << ", skipping words\n";
+        }
+
+        if (results.empty()) {
+            throw std::runtime_error("no datasets found under " + options.data_dir);
+        }
+        if (options.json) {
+            print_json(results);
+        } else {
+            print_csv(results);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -1,5 +1,26 @@
 #include <benchmark/benchmark.h>
 #include <jigsaw/sketch.hpp>
+#include <jigsaw/sharded_sketch.hpp>
+#include <jigsaw/concurrent_sketch.hpp>
+#include <jigsaw/dynamic_sketch.hpp>
+#include <jigsaw/trace_reader.hpp>
+#include <jigsaw/tokenizer.hpp>
+#include <jigsaw/windowed_sketch.hpp>
+#include <jigsaw/top_k.hpp>
+#include <jigsaw/versioned_sketch.hpp>
+#include <jigsaw/epoch_sketch.hpp>
+#include <jigsaw/interned_sketch.hpp>
+#include <jigsaw/sketch_types.hpp>
+#include "perf_counters.hpp"
+#include "workload.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <thread>
 #include <vector>
 #include <random>
 
@@ -111,4 +132,832 @@ static void BM_SketchInsertionCore(benchmark::State& state) {
 }
 BENCHMARK(BM_SketchInsertionCore);
 
+// Compare bucket layouts on the Medium/Large cell counts, where the
+// per-packet probe dominates
+template<typename Layout, uint32_t BucketNum, uint32_t CellNum>
+static void BM_LayoutInsertion(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, BucketNum, 79, CellNum, CellNum, Layout>>();
+
+    constexpr size_t flow_count = 1 << 16;
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(flows[index & (flow_count - 1)]);
+        benchmark::DoNotOptimize(sketch.get());
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::AoSLayout, 4096, 16);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::SoALayout, 4096, 16);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::ColocatedLayout, 4096, 16);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::PackedLayout<>, 4096, 16);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::AoSLayout, 16384, 32);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::SoALayout, 16384, 32);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::PaddedSoALayout, 16384, 32);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::ColocatedLayout, 16384, 32);
+BENCHMARK_TEMPLATE(BM_LayoutInsertion, jigsaw::PackedLayout<>, 16384, 32);
+
+// Auxiliary-list slot read + write at random slots of a Large-sized list
+// (16384 x 32 slots), specialized for the slot width and packed or padded
+template<uint32_t LeftPartBits, bool Padded>
+static void BM_LeftPartAccess(benchmark::State& state) {
+    using Codec = jigsaw::auxiliary::SlotCodec<LeftPartBits, Padded>;
+    constexpr uint64_t slot_num = 16384 * 32;
+    std::vector<uint64_t> words(Codec::word_num(slot_num), 0);
+
+    std::vector<uint32_t> slots(1 << 16);
+    std::mt19937 rng(42);
+    for (auto& slot : slots) {
+        slot = rng() % slot_num;
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        uint64_t left_part[Codec::LEFT_PART_WORDS];
+        uint64_t slot = slots[index & (slots.size() - 1)];
+        uint8_t counter = Codec::get_left_part(words.data(), slot, left_part);
+        left_part[0] += counter + 1;
+        Codec::set_left_part(words.data(), slot, left_part);
+        benchmark::DoNotOptimize(left_part);
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_LeftPartAccess, 79, false);
+BENCHMARK_TEMPLATE(BM_LeftPartAccess, 79, true);
+BENCHMARK_TEMPLATE(BM_LeftPartAccess, 104, false);
+BENCHMARK_TEMPLATE(BM_LeftPartAccess, 104, true);
+BENCHMARK_TEMPLATE(BM_LeftPartAccess, 268, false);
+
+// Hash cost alone for a 256-key batch: splitting each key next to its
+// bucket prefetch (0), or the whole batch with divide_keys first (1)
+static void BM_DivideKeys(benchmark::State& state) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32, jigsaw::SoALayout>;
+    auto sketch = std::make_unique<TestSketch>();
+    constexpr size_t batch = 256;
+    std::vector<jigsaw::IPv4Flow> flows;
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < batch; ++i) {
+        flows.push_back(generator.next());
+    }
+    uint32_t bucket_idx[batch];
+    uint16_t fp[batch];
+    uint64_t left_part[batch][TestSketch::LEFT_PART_WORDS];
+
+    for (auto _ : state) {
+        if (state.range(0)) {
+            TestSketch::divide_keys(flows.data(), batch, bucket_idx, fp, left_part);
+            for (size_t i = 0; i < batch; i++) {
+                sketch->prefetch(bucket_idx[i]);
+            }
+        } else {
+            for (size_t i = 0; i < batch; i++) {
+                TestSketch::divide_key(flows[i], bucket_idx[i], fp[i], left_part[i]);
+                sketch->prefetch(bucket_idx[i]);
+            }
+        }
+        benchmark::DoNotOptimize(bucket_idx);
+        benchmark::DoNotOptimize(left_part);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_DivideKeys)->Arg(0)->Arg(1);
+
+// Bucket update cost alone: keys are split before the timed loop
+static void BM_InsertHashed(benchmark::State& state) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32, jigsaw::SoALayout>;
+    auto sketch = std::make_unique<TestSketch>();
+    constexpr size_t flow_count = 1 << 16;
+    std::vector<jigsaw::IPv4Flow> flows;
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+    std::vector<uint32_t> bucket_idx(flow_count);
+    std::vector<uint16_t> fp(flow_count);
+    std::vector<std::array<uint64_t, TestSketch::LEFT_PART_WORDS>> left_part(flow_count);
+    TestSketch::divide_keys(flows.data(), flow_count, bucket_idx.data(), fp.data(),
+                            reinterpret_cast<uint64_t (*)[TestSketch::LEFT_PART_WORDS]>(left_part.data()));
+
+    size_t index = 0;
+    for (auto _ : state) {
+        size_t i = index & (flow_count - 1);
+        sketch->insert_hashed(bucket_idx[i], fp[i], left_part[i].data());
+        benchmark::DoNotOptimize(sketch.get());
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InsertHashed);
+
+// Keys of each type with random bytes
+template<typename KeyType>
+static std::vector<KeyType> random_keys(size_t n) {
+    std::mt19937 rng(42);
+    std::vector<KeyType> keys(n);
+    for (auto& key : keys) {
+        uint8_t bytes[KeyType::SIZE];
+        for (auto& byte : bytes) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        key = KeyType{};
+        memcpy(static_cast<void*>(&key), bytes, KeyType::SIZE);
+    }
+    return keys;
+}
+
+// Splitting a key and decoding it again, without touching a sketch
+template<typename KeyType>
+static void BM_KeySplit(benchmark::State& state) {
+    using Hasher = jigsaw::KeyHasher<KeyType, 4096>;
+    auto keys = random_keys<KeyType>(1 << 12);
+
+    size_t index = 0;
+    for (auto _ : state) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[std::max<uint32_t>(2, Hasher::LEFT_PART_WORDS)] = {};
+        Hasher::divide_key(keys[index & (keys.size() - 1)], bucket_idx, fp, left_part);
+        KeyType decoded;
+        Hasher::combine_key(decoded, bucket_idx, fp, left_part);
+        benchmark::DoNotOptimize(decoded);
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::IPv4Flow);
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::IPv6Flow);
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::GenericKey<16>);
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::GenericKey<64>);
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::CompactStringKey);
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::StringKey<16>);
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::StringKey<32, 6>);
+BENCHMARK_TEMPLATE(BM_KeySplit, jigsaw::StringKey<64>);
+
+// Insertion per key type, each with the left part it needs to decode keys
+template<typename KeyType>
+static void BM_KeyTypeInsertion(benchmark::State& state) {
+    constexpr uint32_t left_part_bits = jigsaw::KeyHasher<KeyType, 4096>::LEFT_PART_BITS;
+    auto sketch = std::make_unique<jigsaw::Sketch<KeyType, 4096, left_part_bits, 16, 16, jigsaw::SoALayout>>();
+    auto keys = random_keys<KeyType>(1 << 16);
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(keys[index & (keys.size() - 1)]);
+        benchmark::DoNotOptimize(sketch.get());
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::IPv4Flow);
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::CompactStringKey);
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::IPv6Flow);
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::GenericKey<16>);
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::GenericKey<64>);
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::StringKey<16>);
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::StringKey<32, 6>);
+BENCHMARK_TEMPLATE(BM_KeyTypeInsertion, jigsaw::StringKey<64>);
+
+// Strings of state.range(0) bytes, Zipf-popular, through InternedStringSketch
+static void BM_InternedInsertion(benchmark::State& state) {
+    jigsaw::InternedStringSketch<4096, 16, 16> sketch(1);
+    const size_t length = static_cast<size_t>(state.range(0));
+    std::vector<std::string> vocabulary(1 << 16);
+    for (size_t i = 0; i < vocabulary.size(); i++) {
+        vocabulary[i] = std::string(length, 'x');
+        const std::string id = std::to_string(i);
+        vocabulary[i].replace(length - id.size(), id.size(), id);
+    }
+    workload::ZipfSampler sampler(vocabulary.size(), 1.0);
+    std::mt19937_64 rng(42);
+    std::vector<std::string_view> keys(1 << 16);
+    for (auto& key : keys) {
+        key = vocabulary[sampler(rng)];
+    }
+
+    for (auto _ : state) {
+        sketch.insert_batch(keys.data(), keys.size());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+    state.counters["dictionary"] = double(sketch.dictionary_size());
+}
+BENCHMARK(BM_InternedInsertion)->Arg(32)->Arg(256);
+
+// Runtime-sized DynamicSketch against the compile-time SoA Sketch on the
+// same LargeSketch dimensions; range(0) enables huge pages
+static void BM_DynamicInsertion(benchmark::State& state) {
+    jigsaw::DynamicSketch<jigsaw::IPv4Flow> sketch({16384, 79, 32, 32, state.range(0) != 0});
+
+    constexpr size_t flow_count = 1 << 16;
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch.insert(flows[index & (flow_count - 1)]);
+        benchmark::DoNotOptimize(&sketch);
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(sketch.huge_tlb() ? "hugetlb" : "");
+}
+BENCHMARK(BM_DynamicInsertion)->Arg(0)->Arg(1);
+
+// Bucket indexing across power-of-two and other bucket counts; the flow set
+// is larger than the sketch so every insert takes the full reduction path
+template<uint32_t BucketNum>
+static void BM_BucketNumInsertion(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, BucketNum, 79, 8, 8, jigsaw::SoALayout>>();
+
+    constexpr size_t flow_count = 1 << 16;
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(flows[index & (flow_count - 1)]);
+        benchmark::DoNotOptimize(sketch.get());
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 1000);
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 1024);
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 5000);
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 4096);
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 20000);
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 16384);
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 100000);
+BENCHMARK_TEMPLATE(BM_BucketNumInsertion, 131072);
+
+// Same matrix with the bucket count chosen at runtime
+static void BM_DynamicBucketNumInsertion(benchmark::State& state) {
+    jigsaw::DynamicSketch<jigsaw::IPv4Flow> sketch({static_cast<uint32_t>(state.range(0)), 79, 8, 8, false});
+
+    constexpr size_t flow_count = 1 << 16;
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch.insert(flows[index & (flow_count - 1)]);
+        benchmark::DoNotOptimize(&sketch);
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DynamicBucketNumInsertion)
+    ->Arg(1000)->Arg(1024)->Arg(5000)->Arg(4096)->Arg(20000)->Arg(16384)->Arg(100000)->Arg(131072);
+
+// Batched insertion on the large configuration, where random bucket
+// accesses miss in L1/L2. Batch size 1 is the one-at-a-time baseline.
+static void BM_SketchInsertBatch(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32>>();
+    const size_t batch_size = static_cast<size_t>(state.range(0));
+
+    constexpr size_t flow_count = 1 << 20;
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert_batch(&flows[index], batch_size);
+        benchmark::DoNotOptimize(sketch.get());
+        index += batch_size;
+        if (index + batch_size > flow_count) {
+            index = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_SketchInsertBatch)->RangeMultiplier(2)->Range(1, 256);
+
+static void BM_SketchQueryBatch(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32>>();
+    const size_t batch_size = static_cast<size_t>(state.range(0));
+
+    constexpr size_t flow_count = 1 << 20;
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+    sketch->insert_batch(flows.data(), flows.size());
+
+    std::vector<uint32_t> counts(batch_size);
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->query_batch(&flows[index], batch_size, counts.data());
+        benchmark::DoNotOptimize(counts.data());
+        index += batch_size;
+        if (index + batch_size > flow_count) {
+            index = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_SketchQueryBatch)->RangeMultiplier(2)->Range(1, 256);
+
+// Each benchmark thread plays one worker that owns a shard and inserts
+// only the flows routed to it
+static void BM_ShardedInsert(benchmark::State& state) {
+    using Sharded = jigsaw::ShardedSketch<jigsaw::IPv4Flow, 4096, 79, 16, 16>;
+    static std::unique_ptr<Sharded> sketch;
+    static std::vector<std::vector<jigsaw::IPv4Flow>> partitions;
+    constexpr size_t batch_size = 64;
+
+    if (state.thread_index() == 0) {
+        sketch = std::make_unique<Sharded>(state.threads());
+        partitions.assign(state.threads(), {});
+        FlowGenerator generator(42);
+        for (size_t i = 0; i < (size_t(1) << 20); ++i) {
+            auto flow = generator.next();
+            partitions[sketch->shard_of(flow)].push_back(flow);
+        }
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        const auto& flows = partitions[state.thread_index()];
+        if (index + batch_size > flows.size()) {
+            index = 0;
+        }
+        sketch->insert_batch(state.thread_index(), &flows[index], batch_size);
+        index += batch_size;
+    }
+    state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_ShardedInsert)
+    ->ThreadRange(1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())))
+    ->UseRealTime();
+
+// All threads hit one shared sketch. range(0) is the number of distinct
+// flows: a small hot set makes every thread fight over the same cells.
+static void BM_ConcurrentInsert(benchmark::State& state) {
+    using Shared = jigsaw::ConcurrentSketch<jigsaw::IPv4Flow, 4096, 79, 16, 16>;
+    static std::unique_ptr<Shared> sketch;
+    if (state.thread_index() == 0) {
+        sketch = std::make_unique<Shared>();
+    }
+
+    const size_t flow_count = static_cast<size_t>(state.range(0));
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+    FlowGenerator generator(42 + state.thread_index());
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(flows[index & (flow_count - 1)]);
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcurrentInsert)
+    ->Arg(16)->Arg(1 << 20)
+    ->ThreadRange(1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())))
+    ->UseRealTime();
+
+// Merging full LargeSketch-sized snapshots; range(0) is the thread count
+static void BM_SketchMerge(benchmark::State& state) {
+    using Large = jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32>;
+    auto target = std::make_unique<Large>();
+    auto snapshot = std::make_unique<Large>();
+
+    FlowGenerator generator(42);
+    std::vector<jigsaw::IPv4Flow> flows;
+    for (size_t i = 0; i < (size_t(1) << 21); ++i) {
+        flows.push_back(generator.next());
+    }
+    target->insert_batch(flows.data(), flows.size() / 2);
+    snapshot->insert_batch(flows.data() + flows.size() / 2, flows.size() / 2);
+
+    const size_t thread_num = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        if (thread_num == 1) {
+            target->merge(*snapshot);
+        } else {
+            target->merge_parallel(*snapshot, thread_num);
+        }
+        benchmark::DoNotOptimize(target.get());
+    }
+    state.SetItemsProcessed(state.iterations() * 16384);
+}
+BENCHMARK(BM_SketchMerge)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Reloading a LargeSketch snapshot: range(0) == 0 copies it in with load(),
+// range(0) == 1 maps it with a View and answers a query from the mapping
+static void BM_SketchLoad(benchmark::State& state) {
+    using Large = jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32>;
+    auto sketch = std::make_unique<Large>();
+    FlowGenerator generator(42);
+    std::vector<jigsaw::IPv4Flow> flows;
+    for (size_t i = 0; i < (size_t(1) << 20); ++i) {
+        flows.push_back(generator.next());
+    }
+    sketch->insert_batch(flows.data(), flows.size());
+
+    const std::string path = "bench_sketch_snapshot.bin";
+    sketch->save(path);
+
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            sketch->load(path);
+            benchmark::DoNotOptimize(sketch->query(flows[0]));
+        } else {
+            auto view = Large::view(path);
+            benchmark::DoNotOptimize(view.query(flows[0]));
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * Large::SERIALIZED_SIZE);
+    std::remove(path.c_str());
+}
+BENCHMARK(BM_SketchLoad)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+template<typename Rng>
+static void BM_ZipfInsertion(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 4096, 79, 16, 16, jigsaw::SoALayout, Rng>>(1);
+    // Zipf over a large flow population: most inserts miss and take the
+    // probabilistic replacement path
+    static const auto packets = workload::zipf(size_t(1) << 20, size_t(1) << 20, 1.0);
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(packets[index & (packets.size() - 1)]);
+        benchmark::DoNotOptimize(sketch.get());
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_ZipfInsertion, std::mt19937);
+BENCHMARK_TEMPLATE(BM_ZipfInsertion, jigsaw::WyRand);
+
+// Sliding window of 8 Medium sub-sketches, rotated every state.range(0)
+// inserts; rotation is O(1), retired buckets are cleared as they are reused
+static void BM_WindowedInsertion(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::WindowedSketch<jigsaw::IPv4Flow, 4096, 79, 16, 16, jigsaw::SoALayout>>(8);
+    const size_t epoch_length = state.range(0);
+
+    constexpr size_t flow_count = 1 << 16;
+    std::vector<jigsaw::IPv4Flow> flows;
+    flows.reserve(flow_count);
+    FlowGenerator generator(42);
+    for (size_t i = 0; i < flow_count; ++i) {
+        flows.push_back(generator.next());
+    }
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(flows[index & (flow_count - 1)]);
+        if (++index % epoch_length == 0) {
+            sketch->rotate();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WindowedInsertion)->Arg(1 << 12)->Arg(1 << 20);
+
+// Full sweep of a Large sketch, the per-rotation cost a ring of eagerly
+// cleared sketches would put on the packet path
+static void BM_SketchClear(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32, jigsaw::SoALayout>>();
+    for (auto _ : state) {
+        sketch->clear();
+        benchmark::DoNotOptimize(sketch.get());
+    }
+}
+BENCHMARK(BM_SketchClear)->Unit(benchmark::kMicrosecond);
+
+// Reporting the top 10 from a filled Large sketch: full heavy-flow scan,
+// scan-and-select, and the incrementally tracked top-k
+static void BM_TopKReport(benchmark::State& state) {
+    using LargeSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 16384, 79, 32, 32, jigsaw::SoALayout>;
+    auto sketch = std::make_unique<jigsaw::TopKSketch<jigsaw::IPv4Flow, 16384, 79, 32, 32, jigsaw::SoALayout>>(10);
+    static const auto trace = workload::zipf(size_t(1) << 20, size_t(1) << 20, 1.0);
+    sketch->insert_batch(trace.data(), trace.size());
+    const LargeSketch& inner = sketch->sketch();
+
+    for (auto _ : state) {
+        switch (state.range(0)) {
+        case 0: benchmark::DoNotOptimize(inner.get_heavy_flows()); break;
+        case 1: benchmark::DoNotOptimize(inner.top_k(10)); break;
+        default: benchmark::DoNotOptimize(sketch->top_k()); break;
+        }
+    }
+}
+BENCHMARK(BM_TopKReport)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+// Insert cost of keeping the running top-k
+static void BM_TopKInsertion(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::TopKSketch<jigsaw::IPv4Flow, 4096, 79, 16, 16, jigsaw::SoALayout>>(10);
+    static const auto trace = workload::zipf(size_t(1) << 20, size_t(1) << 20, 1.0);
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(trace[index++ & (trace.size() - 1)]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TopKInsertion);
+
+// Writer-side cost of the per-bucket sequence counters
+static void BM_VersionedInsertion(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::VersionedSketch<jigsaw::IPv4Flow, 4096, 79, 16, 16, jigsaw::SoALayout>>();
+    static const auto trace = workload::zipf(size_t(1) << 20, size_t(1) << 20, 1.0);
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert(trace[index++ & (trace.size() - 1)]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VersionedInsertion);
+
+// Ingestion with an export (flip, top-100 decode, streaming clear) every
+// state.range(0) batches, all on one thread here; in production the export
+// runs on its own thread and ingestion never waits for it
+static void BM_EpochExport(benchmark::State& state) {
+    auto sketch = std::make_unique<jigsaw::EpochSketch<jigsaw::IPv4Flow, 16384, 79, 32, 32, jigsaw::SoALayout>>();
+    static const auto trace = workload::zipf(size_t(1) << 20, size_t(1) << 20, 1.0);
+    constexpr size_t batch = 256;
+
+    size_t index = 0;
+    for (auto _ : state) {
+        sketch->insert_batch(&trace[index & (trace.size() - 1)], batch);
+        index += batch;
+        if (index % (batch * state.range(0)) == 0) {
+            sketch->export_epoch([](const auto& retired) { benchmark::DoNotOptimize(retired.top_k(100)); });
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_EpochExport)->Arg(1 << 10)->Arg(1 << 14);
+
+// Converting packed 13-byte trace records into IPv4Flow batches
+static void BM_TraceDecode(benchmark::State& state) {
+    constexpr size_t record_num = 1 << 14;
+    std::vector<uint8_t> records(record_num * jigsaw::TRACE_RECORD_SIZE);
+    std::mt19937 rng(42);
+    for (auto& byte : records) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    std::vector<jigsaw::IPv4Flow> flows(record_num);
+
+    for (auto _ : state) {
+        jigsaw::decode_trace_records(records.data(), record_num, flows.data());
+        benchmark::DoNotOptimize(flows.data());
+    }
+    state.SetItemsProcessed(state.iterations() * record_num);
+    state.SetBytesProcessed(state.iterations() * records.size());
+}
+BENCHMARK(BM_TraceDecode);
+
+static const std::string& bench_text() {
+    static const std::string text = workload::text(size_t(8) << 20, 50000, 1.0);
+    return text;
+}
+
+// Splitting text into CompactStringKeys: 0 = the bytewise loop word_count
+// used (scan, toupper into a buffer, per-char encode), 1 = tokenize_words
+static void BM_Tokenize(benchmark::State& state) {
+    const std::string& text = bench_text();
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+    size_t word_num = 0;
+
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            auto is_space = [](char c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r'; };
+            const char* p = text.data();
+            const char* end = p + text.size();
+            char buffer[256];
+            word_num = 0;
+            while (p < end) {
+                while (p < end && is_space(*p)) {
+                    p++;
+                }
+                const char* word = p;
+                while (p < end && !is_space(*p)) {
+                    p++;
+                }
+                size_t length = std::min<size_t>(p - word, sizeof(buffer));
+                if (length > 0) {
+                    for (size_t i = 0; i < length; i++) {
+                        buffer[i] = static_cast<char>(std::toupper(word[i]));
+                    }
+                    jigsaw::CompactStringKey key(std::string_view(buffer, length));
+                    benchmark::DoNotOptimize(key);
+                    word_num++;
+                }
+            }
+        } else {
+            word_num = jigsaw::tokenize_words(bytes, text.size(), [](const jigsaw::CompactStringKey* keys, size_t) {
+                benchmark::DoNotOptimize(keys);
+            });
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * word_num);
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Tokenize)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Word count end to end: tokenize_words_parallel over state.range(0)
+// threads, each inserting into its own sketch, merged at the end
+static void BM_WordCount(benchmark::State& state) {
+    using WordSketch = jigsaw::Sketch<jigsaw::CompactStringKey, 4096, 104, 8, 8>;
+    const std::string& text = bench_text();
+    const size_t thread_num = static_cast<size_t>(state.range(0));
+    std::vector<std::unique_ptr<WordSketch>> sketches;
+    for (size_t i = 0; i < thread_num; i++) {
+        sketches.push_back(std::make_unique<WordSketch>(i + 1));
+    }
+    size_t word_num = 0;
+
+    for (auto _ : state) {
+        for (auto& sketch : sketches) {
+            sketch->clear();
+        }
+        word_num = jigsaw::tokenize_words_parallel(
+            reinterpret_cast<const uint8_t*>(text.data()), text.size(), thread_num,
+            [&](size_t part, const jigsaw::CompactStringKey* keys, size_t n) { sketches[part]->insert_batch(keys, n); });
+        for (size_t i = 1; i < thread_num; i++) {
+            sketches[0]->merge(*sketches[i]);
+        }
+        benchmark::DoNotOptimize(sketches[0].get());
+    }
+    state.SetItemsProcessed(state.iterations() * word_num);
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_WordCount)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Skewed workloads from workload.hpp on the Small/Medium/Large sketches, in
+// 256-packet batches. Zipf and heavy-hitter streams mostly hit matched
+// cells; churn and same-bucket collisions mostly take the replacement path.
+// Cache misses per packet are reported where perf_event_open allows.
+// With JIGSAW_ENABLE_STATS, the share of inserts taking each update branch
+static void report_stats(benchmark::State& state, const jigsaw::SketchStats& stats) {
+    if (!jigsaw::STATS_ENABLED || stats.inserts == 0) {
+        return;
+    }
+    const double inserts = double(stats.inserts);
+    state.counters["empty_fill"] = stats.empty_fills / inserts;
+    state.counters["heavy_match"] = stats.heavy_matches / inserts;
+    state.counters["light_match"] = stats.light_matches / inserts;
+    state.counters["promotion"] = stats.promotions / inserts;
+    state.counters["replaced"] = stats.replacements / inserts;
+    state.counters["rejected"] = stats.replacements_rejected / inserts;
+    state.counters["verify"] = stats.verifications / inserts;
+}
+
+template<typename SketchType>
+static void run_workload(benchmark::State& state, const std::vector<jigsaw::IPv4Flow>& packets) {
+    auto sketch = std::make_unique<SketchType>(1);
+    constexpr size_t batch = 256;
+    PerfCounters counters({CYCLES, BRANCH_MISSES, LLC_MISSES, L1D_MISSES});
+
+    size_t index = 0;
+    counters.start();
+    for (auto _ : state) {
+        sketch->insert_batch(&packets[index], batch);
+        benchmark::DoNotOptimize(sketch.get());
+        index += batch;
+        if (index + batch > packets.size()) {
+            index = 0;
+        }
+    }
+    counters.stop();
+    state.SetItemsProcessed(state.iterations() * batch);
+    counters.report(state, double(state.iterations() * batch));
+    report_stats(state, sketch->stats());
+}
+
+// Streams are generated once per argument and shared across sketch sizes
+template<typename Generate>
+static const std::vector<jigsaw::IPv4Flow>& cached_workload(std::map<int64_t, std::vector<jigsaw::IPv4Flow>>& cache,
+                                                            int64_t arg, Generate generate) {
+    auto it = cache.find(arg);
+    if (it == cache.end()) {
+        it = cache.emplace(arg, generate()).first;
+    }
+    return it->second;
+}
+
+constexpr size_t WORKLOAD_PACKETS = size_t(1) << 20;
+
+// Zipf over 1M flows; state.range(0) is the skew in hundredths
+template<typename SketchType>
+static void BM_WorkloadZipf(benchmark::State& state) {
+    static std::map<int64_t, std::vector<jigsaw::IPv4Flow>> cache;
+    run_workload<SketchType>(state, cached_workload(cache, state.range(0), [&] {
+        return workload::zipf(WORKLOAD_PACKETS, size_t(1) << 20, state.range(0) / 100.0);
+    }));
+}
+
+// state.range(0) percent of packets from 1000 heavy flows, the rest from
+// one-packet flows
+template<typename SketchType>
+static void BM_WorkloadHeavyHitters(benchmark::State& state) {
+    static std::map<int64_t, std::vector<jigsaw::IPv4Flow>> cache;
+    run_workload<SketchType>(state, cached_workload(cache, state.range(0), [&] {
+        return workload::heavy_hitters(WORKLOAD_PACKETS, 1000, state.range(0) / 100.0);
+    }));
+}
+
+// Zipf (skew 1) packet trains of mean length state.range(0)
+template<typename SketchType>
+static void BM_WorkloadBursts(benchmark::State& state) {
+    static std::map<int64_t, std::vector<jigsaw::IPv4Flow>> cache;
+    run_workload<SketchType>(state, cached_workload(cache, state.range(0), [&] {
+        return workload::bursts(WORKLOAD_PACKETS, size_t(1) << 20, 1.0, size_t(state.range(0)));
+    }));
+}
+
+// 100k active flows (Zipf, skew 1) replaced after state.range(0) packets
+// on average
+template<typename SketchType>
+static void BM_WorkloadChurn(benchmark::State& state) {
+    static std::map<int64_t, std::vector<jigsaw::IPv4Flow>> cache;
+    run_workload<SketchType>(state, cached_workload(cache, state.range(0), [&] {
+        return workload::churn(WORKLOAD_PACKETS, 100000, 1.0, size_t(state.range(0)));
+    }));
+}
+
+// state.range(0) flows colliding in one bucket, round robin
+template<typename SketchType>
+static void BM_WorkloadCollisions(benchmark::State& state) {
+    static std::map<int64_t, std::vector<jigsaw::IPv4Flow>> cache;
+    run_workload<SketchType>(state, cached_workload(cache, state.range(0), [&] {
+        return workload::same_bucket<SketchType>(WORKLOAD_PACKETS, size_t(state.range(0)));
+    }));
+}
+
+#define WORKLOAD_BENCHMARKS(SketchType)                                                  \
+    BENCHMARK_TEMPLATE(BM_WorkloadZipf, SketchType)->Arg(80)->Arg(110)->Arg(140);          \
+    BENCHMARK_TEMPLATE(BM_WorkloadHeavyHitters, SketchType)->Arg(50)->Arg(90);             \
+    BENCHMARK_TEMPLATE(BM_WorkloadBursts, SketchType)->Arg(8)->Arg(64);                    \
+    BENCHMARK_TEMPLATE(BM_WorkloadChurn, SketchType)->Arg(1000)->Arg(100000);              \
+    BENCHMARK_TEMPLATE(BM_WorkloadCollisions, SketchType)->Arg(8)->Arg(256)
+
+WORKLOAD_BENCHMARKS(jigsaw::SmallSketch);
+WORKLOAD_BENCHMARKS(jigsaw::MediumSketch);
+WORKLOAD_BENCHMARKS(jigsaw::LargeSketch);
+WORKLOAD_BENCHMARKS(jigsaw::LargePackedSketch);
+
+// Byte counting: one weighted update per packet (1) against the unit
+// insert_batch on the same Zipf stream (0)
+static void BM_WeightedInsertion(benchmark::State& state) {
+    static const auto packets = workload::zipf(WORKLOAD_PACKETS, size_t(1) << 20, 1.0);
+    static const auto sizes = workload::packet_sizes(packets);
+    auto sketch = std::make_unique<jigsaw::MediumSketch>(1);
+    constexpr size_t batch = 256;
+
+    size_t index = 0;
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            sketch->insert_batch(&packets[index], batch);
+        } else {
+            sketch->insert_batch(&packets[index], &sizes[index], batch);
+        }
+        benchmark::DoNotOptimize(sketch.get());
+        index += batch;
+        if (index + batch > packets.size()) {
+            index = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_WeightedInsertion)->Arg(0)->Arg(1);
+
 BENCHMARK_MAIN(); 
\ No newline at end of file
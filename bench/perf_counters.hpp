@@ -0,0 +1,88 @@
+#pragma once
+#include <benchmark/benchmark.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+// Hardware event counts for the calling thread, read through
+// perf_event_open around a benchmark's timed loop. Events the machine does
+// not expose (no PMU in a VM, perf_event_paranoid too strict) are skipped,
+// so a benchmark reports throughput alone rather than failing.
+struct PerfEvent {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+inline constexpr PerfEvent CYCLES{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+inline constexpr PerfEvent BRANCH_MISSES{"branch_miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+inline constexpr PerfEvent LLC_MISSES{"llc_miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+inline constexpr PerfEvent L1D_MISSES{"l1d_miss", PERF_TYPE_HW_CACHE,
+                                      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+class PerfCounters {
+public:
+    PerfCounters(std::initializer_list<PerfEvent> events) {
+        for (const auto& event : events) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = event.type;
+            attr.config = event.config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd >= 0) {
+                counters_.push_back({event, fd, 0});
+            }
+        }
+    }
+
+    ~PerfCounters() {
+        for (const auto& counter : counters_) {
+            close(counter.fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start() {
+        for (const auto& counter : counters_) {
+            ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop() {
+        for (auto& counter : counters_) {
+            ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter.fd, &counter.value, sizeof(counter.value)) != sizeof(counter.value)) {
+                counter.value = 0;
+            }
+        }
+    }
+
+    // Each available event as a per-item average, next to items_per_second
+    void report(benchmark::State& state, double items) const {
+        for (const auto& counter : counters_) {
+            state.counters[counter.event.name] = items > 0 ? double(counter.value) / items : 0;
+        }
+    }
+
+private:
+    struct Counter {
+        PerfEvent event;
+        int fd;
+        uint64_t value;
+    };
+
+    std::vector<Counter> counters_;
+};
@@ -0,0 +1,197 @@
+#pragma once
+#include <jigsaw/sketch.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Packet streams that resemble real traffic more than uniform random
+// flows do. Each generator returns packet_num flow keys, reproducible for
+// a given seed, for a benchmark to replay.
+namespace workload {
+
+// splitmix64 finalizer, a bijection on 64-bit words
+inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// A distinct, random-looking 5-tuple for every id
+inline jigsaw::IPv4Flow flow_of(uint64_t id) {
+    // mix64 is a bijection, so the two addresses alone tell ids apart
+    const uint64_t addresses = mix64(id);
+    const uint64_t rest = mix64(id + 0x9E3779B97F4A7C15ULL);
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = static_cast<uint32_t>(addresses);
+    flow.dst_ip = static_cast<uint32_t>(addresses >> 32);
+    flow.src_port = static_cast<uint16_t>(rest);
+    flow.dst_port = static_cast<uint16_t>(rest >> 16);
+    flow.protocol = static_cast<uint8_t>(rest >> 32);
+    return flow;
+}
+
+// Ranks 0..n-1 drawn with probability proportional to 1 / (rank + 1)^skew
+class ZipfSampler {
+public:
+    ZipfSampler(size_t n, double skew) : cdf_(n) {
+        double sum = 0;
+        for (size_t rank = 0; rank < n; rank++) {
+            sum += 1.0 / std::pow(double(rank + 1), skew);
+            cdf_[rank] = sum;
+        }
+    }
+
+    template<typename Rng>
+    size_t operator()(Rng& rng) const {
+        const double u = std::uniform_real_distribution<double>(0, cdf_.back())(rng);
+        return std::min<size_t>(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin(), cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+// A plausible length in bytes for a flow's seq-th packet: a quarter of the
+// flows (by hash) are bulk transfers of mostly 1500-byte packets, the rest
+// send small 40 to 119-byte packets. For byte-weighted inserts on traces
+// that record no lengths, such as the .dat files.
+inline uint32_t packet_bytes(const jigsaw::IPv4Flow& flow, uint64_t seq) {
+    const uint64_t flow_hash = mix64((uint64_t(flow.src_ip) << 32 | flow.dst_ip) ^
+                                   mix64(uint64_t(flow.src_port) << 24 | uint64_t(flow.dst_port) << 8 | flow.protocol));
+    const uint64_t packet_hash = mix64(flow_hash ^ seq);
+    if ((flow_hash & 3) == 0) {
+        return packet_hash % 8 == 0 ? 40 + uint32_t(packet_hash >> 8) % 1461 : 1500;
+    }
+    return 40 + uint32_t(packet_hash >> 8) % 80;
+}
+
+// packet_bytes for every packet of a stream
+inline std::vector<uint32_t> packet_sizes(const std::vector<jigsaw::IPv4Flow>& packets) {
+    std::vector<uint32_t> sizes(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) {
+        sizes[i] = packet_bytes(packets[i], i);
+    }
+    return sizes;
+}
+
+// Zipf popularity over flow_num flows: a few elephants and a long tail of
+// mice. Larger skews concentrate the packets on fewer flows.
+inline std::vector<jigsaw::IPv4Flow> zipf(size_t packet_num, size_t flow_num, double skew, uint64_t seed = 42) {
+    ZipfSampler sampler(flow_num, skew);
+    std::mt19937_64 rng(seed);
+    std::vector<jigsaw::IPv4Flow> packets(packet_num);
+    for (auto& packet : packets) {
+        packet = flow_of(sampler(rng));
+    }
+    return packets;
+}
+
+// heavy_share of the packets spread evenly over heavy_num flows; every
+// other packet belongs to a flow of its own
+inline std::vector<jigsaw::IPv4Flow> heavy_hitters(size_t packet_num, size_t heavy_num, double heavy_share,
+                                                   uint64_t seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::bernoulli_distribution heavy(heavy_share);
+    std::uniform_int_distribution<uint64_t> pick(0, heavy_num - 1);
+    std::vector<jigsaw::IPv4Flow> packets(packet_num);
+    uint64_t next_mouse = heavy_num;
+    for (auto& packet : packets) {
+        packet = flow_of(heavy(rng) ? pick(rng) : next_mouse++);
+    }
+    return packets;
+}
+
+// Zipf-chosen flows sending trains of back-to-back packets, uniformly 1 to
+// 2 * mean_burst - 1 long
+inline std::vector<jigsaw::IPv4Flow> bursts(size_t packet_num, size_t flow_num, double skew, size_t mean_burst,
+                                            uint64_t seed = 42) {
+    ZipfSampler sampler(flow_num, skew);
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<size_t> length(1, 2 * std::max<size_t>(mean_burst, 1) - 1);
+    std::vector<jigsaw::IPv4Flow> packets;
+    packets.reserve(packet_num);
+    while (packets.size() < packet_num) {
+        const jigsaw::IPv4Flow flow = flow_of(sampler(rng));
+        packets.insert(packets.end(), std::min(length(rng), packet_num - packets.size()), flow);
+    }
+    return packets;
+}
+
+// Zipf popularity over active_num slots whose flows come and go: after each
+// packet its slot passes to a brand-new flow with probability 1 / lifetime,
+// so elephants are replaced too and the sketch must keep evicting
+inline std::vector<jigsaw::IPv4Flow> churn(size_t packet_num, size_t active_num, double skew, size_t lifetime,
+                                           uint64_t seed = 42) {
+    ZipfSampler sampler(active_num, skew);
+    std::mt19937_64 rng(seed);
+    std::bernoulli_distribution ends(1.0 / std::max<size_t>(lifetime, 1));
+    std::vector<uint64_t> active(active_num);
+    for (size_t i = 0; i < active_num; i++) {
+        active[i] = i;
+    }
+    uint64_t next_flow = active_num;
+    std::vector<jigsaw::IPv4Flow> packets(packet_num);
+    for (auto& packet : packets) {
+        const size_t slot = sampler(rng);
+        packet = flow_of(active[slot]);
+        if (ends(rng)) {
+            active[slot] = next_flow++;
+        }
+    }
+    return packets;
+}
+
+// About byte_num bytes of text: Zipf-chosen words from a vocabulary of
+// vocabulary_num random lowercase words of 1 to 14 letters, separated
+// mostly by spaces and sometimes by newlines, like prose
+inline std::string text(size_t byte_num, size_t vocabulary_num, double skew, uint64_t seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::vector<std::string> vocabulary(vocabulary_num);
+    for (auto& word : vocabulary) {
+        word.resize(1 + rng() % 14);
+        for (auto& c : word) {
+            c = static_cast<char>('a' + rng() % 26);
+        }
+    }
+    ZipfSampler sampler(vocabulary_num, skew);
+    std::string text;
+    text.reserve(byte_num + 16);
+    while (text.size() < byte_num) {
+        text += vocabulary[sampler(rng)];
+        text += rng() % 12 == 0 ? '\n' : ' ';
+    }
+    return text;
+}
+
+// Adversarial: flow_num distinct flows that all hash to one bucket of
+// SketchType, sent round robin. With more flows than the bucket has cells
+// nearly every packet misses and contends for the same replacement.
+template<typename SketchType>
+std::vector<jigsaw::IPv4Flow> same_bucket(size_t packet_num, size_t flow_num, uint64_t seed = 42) {
+    std::vector<jigsaw::IPv4Flow> flows;
+    uint32_t target = 0;
+    for (uint64_t id = seed << 32; flows.size() < flow_num; id++) {
+        const jigsaw::IPv4Flow flow = flow_of(id);
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(flow, bucket_idx, fp, left_part);
+        if (flows.empty()) {
+            target = bucket_idx;
+        }
+        if (bucket_idx == target) {
+            flows.push_back(flow);
+        }
+    }
+
+    std::vector<jigsaw::IPv4Flow> packets(packet_num);
+    for (size_t i = 0; i < packet_num; i++) {
+        packets[i] = flows[i % flow_num];
+    }
+    return packets;
+}
+
+} // namespace workload
@@ -5,122 +5,63 @@
 #include <chrono>
 #include <unordered_map>
 #include <jigsaw/sketch.hpp>
+#include <jigsaw/trace_reader.hpp>
 #include <cstring>
 #include <arpa/inet.h>
 #include <iomanip>
 #include <algorithm>
+#include <memory>
+#include <string_view>
 
 using namespace std;
 
 // Constants
 static constexpr size_t INET_ADDRSTR_SIZE = INET_ADDRSTRLEN;
 
-// Use key size from jigsaw config
+// Exact counts are keyed on the flow's SIZE meaningful bytes
 struct HashFunc {
-    size_t operator()(const uint8_t* key) const {
+    size_t operator()(const jigsaw::IPv4Flow& flow) const {
         return std::hash<std::string_view>{}(
-            std::string_view((char*)key, jigsaw::IPv4Flow::SIZE));
+            std::string_view(reinterpret_cast<const char*>(&flow), jigsaw::IPv4Flow::SIZE));
     }
 };
 
 struct CmpFunc {
-    bool operator()(const uint8_t* a, const uint8_t* b) const {
-        return memcmp(a, b, jigsaw::IPv4Flow::SIZE) == 0;
+    bool operator()(const jigsaw::IPv4Flow& a, const jigsaw::IPv4Flow& b) const {
+        return memcmp(&a, &b, jigsaw::IPv4Flow::SIZE) == 0;
     }
 };
 
+using FlowCounts = std::unordered_map<jigsaw::IPv4Flow, unsigned int, HashFunc, CmpFunc>;
+
 class TraceProcessor {
 public:
-    static constexpr size_t kKeySize = jigsaw::Config::KEY_SIZE;
     static constexpr size_t kMaxItems = 40'000'000;
+    static constexpr size_t kReplayBatch = 1 << 14;
 
-private:
-    // Convert from input format to struct format for IPv4
-    static void adaptInputToIPv4Flow(const char* input, char* output) {
-        // Input format: srcIP(4), srcPort(2), dstIP(4), dstPort(2), proto(1)
-        // Output format: srcIP(4), dstIP(4), srcPort(2), dstPort(2), proto(1)
-        
-        uint32_t src_ip, dst_ip;
-        uint16_t src_port, dst_port;
-        uint8_t protocol;
-        
-        // Read values maintaining network byte order
-        memcpy(&src_ip, input, 4);
-        memcpy(&src_port, input + 4, 2);
-        memcpy(&dst_ip, input + 6, 4);
-        memcpy(&dst_port, input + 10, 2);
-        protocol = input[12];
-
-        // Write in struct layout order, keeping network byte order
-        memcpy(output, &src_ip, 4);      // source IP
-        memcpy(output + 4, &dst_ip, 4);  // destination IP
-        memcpy(output + 8, &src_port, 2);  // source port
-        memcpy(output + 10, &dst_port, 2); // destination port
-        output[12] = protocol;           // protocol
-    }
+    explicit TraceProcessor(bool exact) : exact_(exact) {}
 
-    size_t readTraces(const std::string& trace_prefix, 
-                     std::vector<uint8_t*>& keys,
-                     std::unordered_map<uint8_t*, unsigned int, HashFunc, CmpFunc>& flow_sizes) {
-        size_t total_count = 0;
+private:
+    bool exact_;
 
+    // 0.dat .. 10.dat that exist under prefix
+    static std::vector<std::string> findTraces(const std::string& trace_prefix) {
+        std::vector<std::string> paths;
         for (int file_num = 0; file_num <= 10; ++file_num) {
             std::string trace_path = trace_prefix + std::to_string(file_num) + ".dat";
-            std::cout << "Start reading " << trace_path << '\n';
-
-            FILE* fin = fopen(trace_path.c_str(), "rb");
-            if (!fin) {
+            if (std::ifstream(trace_path).good()) {
+                paths.push_back(trace_path);
+            } else {
                 std::cerr << "Failed to open " << trace_path << '\n';
-                continue;
-            }
-
-            size_t file_count = 0;
-            char input_buf[jigsaw::IPv4Flow::SIZE];
-            char adapted_buf[jigsaw::IPv4Flow::SIZE];
-
-            while (fread(input_buf, 1, jigsaw::IPv4Flow::SIZE, fin) == jigsaw::IPv4Flow::SIZE && 
-                   total_count < kMaxItems) {
-                
-                // Adapt the input format to match our struct layout
-                adaptInputToIPv4Flow(input_buf, adapted_buf);
-
-                // Allocate and copy the adapted data
-                uint8_t* key = (uint8_t*)malloc(jigsaw::IPv4Flow::SIZE);
-                if (!key) {
-                    std::cerr << "Memory allocation failed!\n";
-                    break;
-                }
-                memcpy(key, adapted_buf, jigsaw::IPv4Flow::SIZE);
-
-            
-                keys.push_back(key);
-
-            
-                // Debug the hash map insertion
-                auto [it, inserted] = flow_sizes.try_emplace(key, 1);
-                if (!inserted) {
-                    it->second++;
-                }
-                
-                if (++file_count % 5'000'000 == 0) {
-                    std::cout << "\tRead " << file_count << " items from file " 
-                             << file_num << ", total: " << total_count << '\n';
-                }
-                total_count++;
             }
-            
-            fclose(fin);
-            std::cout << "Finished file " << file_num << " (" << file_count 
-                     << " items), total: " << total_count << '\n';
         }
-        
-        return total_count;
+        return paths;
     }
 
     // Protocol number to name mapping
     static const char* getProtocolName(uint8_t protocol) {
         static char unknown_proto[8];  // Buffer for unknown protocol numbers
-        
+
         switch(protocol) {
             case 1: return "ICMP";
             case 6: return "TCP";
@@ -131,115 +72,111 @@ private:
         }
     }
 
-    static void printFlow(const uint8_t* key, unsigned int count) {
-        const jigsaw::IPv4Flow& flow = *reinterpret_cast<const jigsaw::IPv4Flow*>(key);
-        
+    static void printFlow(const jigsaw::IPv4Flow& flow, unsigned int count) {
         // Convert IPs to string representation
         char src_ip[INET_ADDRSTR_SIZE], dst_ip[INET_ADDRSTR_SIZE];
         inet_ntop(AF_INET, &flow.src_ip, src_ip, INET_ADDRSTR_SIZE);
         inet_ntop(AF_INET, &flow.dst_ip, dst_ip, INET_ADDRSTR_SIZE);
-        
+
         std::cout << std::setw(2) << (int)flow.protocol << " "
                  << src_ip << ":" << ntohs(flow.src_port)  // Convert port from network to host for display
                  << " -> " << dst_ip << ":" << ntohs(flow.dst_port)
                  << " " << count << std::endl;
     }
 
-    void printTopFlows(const std::unordered_map<uint8_t*, unsigned int, HashFunc, CmpFunc>& flow_sizes, 
-                      size_t top_n = 10) {
-        // Create vector of pairs for sorting
-        std::vector<std::pair<const uint8_t*, unsigned int>> flows;
-        flows.reserve(flow_sizes.size());
-        
-        for (const auto& [key, count] : flow_sizes) {
-            flows.emplace_back(key, count);
-        }
-        
+    void printTopFlows(std::vector<std::pair<jigsaw::IPv4Flow, unsigned int>> flows,
+                      const char* source, size_t top_n = 10) {
         // Sort by count in descending order
-        std::partial_sort(flows.begin(), 
+        std::partial_sort(flows.begin(),
                          flows.begin() + std::min(top_n, flows.size()),
                          flows.end(),
                          [](const auto& a, const auto& b) { return a.second > b.second; });
-        
-        std::cout << "\nTop " << top_n << " flows:\n";
+
+        std::cout << "\nTop " << top_n << " flows (" << source << "):\n";
         std::cout << std::string(80, '-') << '\n';
-        
+
         for (size_t i = 0; i < std::min(top_n, flows.size()); ++i) {
             printFlow(flows[i].first, flows[i].second);
         }
         std::cout << std::string(80, '-') << '\n';
     }
 
-public:
-    void run() {
-        std::cout << "Preparing dataset\n";
-        
-        std::vector<uint8_t*> keys;
-        keys.reserve(kMaxItems);
-        
-        std::unordered_map<uint8_t*, unsigned int, HashFunc, CmpFunc> flow_sizes;
-        
-        size_t item_count = readTraces("../data/", keys, flow_sizes);
-        
+    // Exact per-flow counts; a separate pass so it stays out of the timings
+    void countExact(const std::vector<std::string>& paths) {
+        FlowCounts flow_sizes;
+        size_t item_count = jigsaw::replay_traces(paths, [&](const jigsaw::IPv4Flow* flows, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                flow_sizes[flows[i]]++;
+            }
+        }, kReplayBatch, kMaxItems);
+
         std::cout << "Items: " << item_count << ", Flows: " << flow_sizes.size() << '\n';
-        printTopFlows(flow_sizes);
+        printTopFlows({flow_sizes.begin(), flow_sizes.end()}, "exact");
         std::cout << "*********************\n";
+    }
 
-        std::cout << "Preparing algorithm\n";
-        jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8> sketch;
-        printMemoryInfo();
-
-        std::cout << "Inserting items\n";
-        auto start = clock();
-        
-        // Keep the hot path as simple as possible
-        for (size_t i = 0; i < item_count; i++) {
-            // Directly reinterpret bytes as IPv4Flow
-            const jigsaw::IPv4Flow& flow = *reinterpret_cast<const jigsaw::IPv4Flow*>(keys[i]);
-            sketch.insert(flow);
-        }
-        
-        auto end = clock();
-        double seconds = static_cast<double>(end - start) / CLOCKS_PER_SEC;
+    // Stream the traces into a fresh sketch; decoding runs on the replay
+    // thread, overlapped with insertion
+    template<typename SketchType>
+    void insertTrace(const char* name, const std::vector<std::string>& paths) {
+        std::cout << "Inserting items (" << name << " layout, "
+                  << SketchType::MEMORY_SIZE / 1024.0 << "KB)\n";
+        auto sketch = std::make_unique<SketchType>();
+        auto start = std::chrono::steady_clock::now();
+
+        size_t item_count = jigsaw::replay_traces(paths, [&](const jigsaw::IPv4Flow* flows, size_t n) {
+            sketch->insert_batch(flows, n);
+        }, kReplayBatch, kMaxItems);
+
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
         double throughput = (item_count / 1e6) / seconds;
-        
-        std::cout << "Time: " << seconds << " seconds\n"
+
+        std::cout << "Items: " << item_count << '\n'
+                 << "Time: " << seconds << " seconds\n"
                  << "Throughput: " << throughput << " Mpps\n"
-                 << "Per insert: " << 1000.0 / throughput << " ns\n"
-                 << "*********************\n";
+                 << "Per insert: " << 1000.0 / throughput << " ns\n";
 
-        // Cleanup
-        for (auto key : keys) {
-            free(key);
+        std::vector<std::pair<jigsaw::IPv4Flow, unsigned int>> heavy;
+        for (const auto& flow : sketch->get_heavy_flows()) {
+            heavy.emplace_back(flow.key, flow.count);
         }
+        printTopFlows(std::move(heavy), name);
+        std::cout << "*********************\n";
     }
 
-private:
-    void printMemoryInfo() const {
-        constexpr uint32_t BUCKET_NUM = 1024;
-        constexpr uint32_t CELL_NUM_H = 8;
-        constexpr uint32_t CELL_NUM_L = 8;
-        constexpr uint32_t LEFT_PART_BITS = 79;
-        
-        double bucketMem = BUCKET_NUM * (CELL_NUM_H + CELL_NUM_L) * ((16+18)/8.0) / 1024.0;
-        uint32_t auxiliaryListWordNum = int(ceil(BUCKET_NUM * CELL_NUM_H * 
-            (LEFT_PART_BITS + jigsaw::Config::EXTRA_BITS_NUM) / 64.0));
-        double auxiliaryListMem = auxiliaryListWordNum * 8 / 1024.0;
-
-        std::cout << "bucketMem: " << bucketMem << "KB\n"
-                 << "auxiliaryListMem: " << auxiliaryListMem << "KB\n"
-                 << "totalMem: " << bucketMem + auxiliaryListMem << "KB\n"
-                 << "*********************\n";
+public:
+    void run() {
+        std::vector<std::string> paths = findTraces("../data/");
+        if (paths.empty()) {
+            throw std::runtime_error("no trace files found");
+        }
+
+        if (exact_) {
+            std::cout << "Counting flows exactly\n";
+            countExact(paths);
+        }
+
+        // Same configuration with left parts in a separate auxiliary list
+        // and colocated with their buckets
+        insertTrace<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8>>("AoS", paths);
+        insertTrace<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8, jigsaw::SoALayout>>("SoA", paths);
+        insertTrace<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8, jigsaw::ColocatedLayout>>("Colocated", paths);
+        // 34-bit cells: 16-bit fingerprint and 18-bit counter
+        insertTrace<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8, jigsaw::PackedLayout<>>>("Packed", paths);
     }
 };
 
-int main() {
+// Usage: flow_processor [--exact]
+//   --exact  also count every flow exactly (slow; needs memory per flow)
+int main(int argc, char** argv) {
     try {
-        TraceProcessor processor;
+        bool exact = argc > 1 && std::string(argv[1]) == "--exact";
+        TraceProcessor processor(exact);
         processor.run();
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << '\n';
         return 1;
     }
     return 0;
-} 
+}
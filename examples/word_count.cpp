@@ -1,12 +1,12 @@
 #include <cstdint>
 #include <iostream>
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <unistd.h>
 #include <chrono>
 #include <jigsaw/sketch.hpp>
+#include <jigsaw/tokenizer.hpp>
 #include <iomanip>
+#include <memory>
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -17,100 +17,62 @@ private:
     static constexpr uint32_t CELL_NUM_H = 8;
     static constexpr uint32_t CELL_NUM_L = 8;
     static constexpr size_t BATCH_SIZE = 1024;  // Match main.rs batch size
-    
-    // Use CompactStringKey instead of StringKey
-    jigsaw::Sketch<jigsaw::CompactStringKey, BUCKET_NUM, LEFT_PART_BITS, CELL_NUM_H, CELL_NUM_L> sketch_;
-    std::unordered_map<std::string, uint64_t> actual_counts_;
-    bool calculate_actual_;
-
-    inline bool is_whitespace(char c) const {
-        return c == ' ' || c == '\n';  // Match main.rs whitespace definition
-    }
 
-public:
-    explicit WordCounter(bool calculate_actual = false) : calculate_actual_(calculate_actual) {}
+    using SketchType = jigsaw::Sketch<jigsaw::CompactStringKey, BUCKET_NUM, LEFT_PART_BITS, CELL_NUM_H, CELL_NUM_L>;
 
-    void process_file(const char* filename) {
-        int fd = open(filename, O_RDONLY);
-        if (fd == -1) {
-            throw std::runtime_error("Failed to open file");
-        }
+    // One sketch (and exact count table) per thread, merged into the first
+    std::vector<std::unique_ptr<SketchType>> sketches_;
+    std::vector<std::unordered_map<std::string, uint64_t>> actual_counts_;
+    bool calculate_actual_;
 
-        struct stat sb;
-        if (fstat(fd, &sb) == -1) {
-            close(fd);
-            throw std::runtime_error("Failed to get file size");
+public:
+    WordCounter(size_t thread_num, bool calculate_actual)
+        : actual_counts_(thread_num), calculate_actual_(calculate_actual) {
+        for (size_t i = 0; i < thread_num; i++) {
+            sketches_.push_back(std::make_unique<SketchType>());
         }
+    }
 
-        const char* data = static_cast<const char*>(
-            mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
-        if (data == MAP_FAILED) {
-            close(fd);
-            throw std::runtime_error("Failed to mmap file");
-        }
+    void process_file(const char* filename) {
+        jigsaw::MappedFile file(filename);
+        file.advise(MADV_SEQUENTIAL);
 
-        const char* end = data + sb.st_size;
-        const char* p = data;
-        size_t total_words = 0;
-        char word_buffer[256];
-        
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        while (p < end) {
-            // Skip whitespace - direct comparison is faster than isspace()
-            while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) {
-                p++;
-            }
-            if (p >= end) break;
-
-            // Found start of word
-            const char* word_start = p;
-            
-            // Find end of word - scan until next whitespace
-            while (p < end && !(*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) {
-                p++;
-            }
-            
-            // Process word
-            size_t word_len = p - word_start;
-            if (word_len > 0 && word_len < 255) {
-                // Copy and convert to uppercase
-                for (size_t i = 0; i < word_len; i++) {
-                    word_buffer[i] = std::toupper(word_start[i]);
-                }
-                word_buffer[word_len] = '\0';
-                
-                // Create CompactStringKey first
-                jigsaw::CompactStringKey key(word_buffer);
-                
-                // Update sketch count
-                sketch_.insert(key);
-
+        // Each thread tokenizes its own whitespace-aligned part of the file
+        size_t total_words = jigsaw::tokenize_words_parallel(
+            file.data(), file.size(), sketches_.size(),
+            [&](size_t part, const jigsaw::CompactStringKey* keys, size_t n) {
+                sketches_[part]->insert_batch(keys, n);
                 // Only update actual counts if requested
                 if (calculate_actual_) {
-                    std::string word = key.to_string();
-                    actual_counts_[word]++;
+                    for (size_t i = 0; i < n; i++) {
+                        actual_counts_[part][keys[i].to_string()]++;
+                    }
                 }
-                total_words++;
+            },
+            BATCH_SIZE);
+
+        for (size_t i = 1; i < sketches_.size(); i++) {
+            sketches_[0]->merge(*sketches_[i]);
+            for (const auto& [word, count] : actual_counts_[i]) {
+                actual_counts_[0][word] += count;
             }
         }
 
         auto end_time = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
-        munmap(const_cast<char*>(data), sb.st_size);
-        close(fd);
-
         std::cout << "Processed " << total_words << " words in " 
-                  << duration.count() << "ms\n"
-                  << "Throughput: " << (total_words * 1000.0 / duration.count()) 
+                  << duration.count() << "ms on " << sketches_.size() << " thread(s)\n"
+                  << "Throughput: " << (total_words * 1000.0 / std::max<int64_t>(duration.count(), 1))
                   << " words/second\n";
 
         print_top_words();
     }
 
     void print_top_words() const {
-        auto flows = sketch_.get_heavy_flows();
+        auto flows = sketches_[0]->top_k(10);
         std::cout << "Top 10 most frequent words:\n";
         
         if (calculate_actual_) {
@@ -131,8 +93,8 @@ public:
             if (count++ >= 10) break;
             
             if (calculate_actual_) {
-                auto actual_it = actual_counts_.find(flow.key.to_string());
-                uint64_t actual_count = actual_it != actual_counts_.end() ? actual_it->second : 0;
+                auto actual_it = actual_counts_[0].find(flow.key.to_string());
+                uint64_t actual_count = actual_it != actual_counts_[0].end() ? actual_it->second : 0;
                 std::cout << std::left << std::setw(20) << flow.key.to_string()
                           << std::right << std::setw(15) << flow.count
                           << std::right << std::setw(15) << actual_count << '\n';
@@ -145,15 +107,30 @@ public:
 };
 
 int main(int argc, char* argv[]) {
-    if (argc < 2 || argc > 3) {
-        std::cerr << "Usage: " << argv[0] << " <input_file> [-a]\n";
+    auto usage = [&] {
+        std::cerr << "Usage: " << argv[0] << " <input_file> [-a] [-t threads]\n";
         std::cerr << "  -a: calculate actual counts (optional)\n";
+        std::cerr << "  -t: tokenize and count on this many threads (default: all cores)\n";
         return 1;
+    };
+    if (argc < 2) {
+        return usage();
     }
 
     try {
-        bool calculate_actual = (argc == 3 && std::string(argv[2]) == "-a");
-        WordCounter counter(calculate_actual);
+        bool calculate_actual = false;
+        size_t thread_num = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "-a") {
+                calculate_actual = true;
+            } else if (arg == "-t" && i + 1 < argc) {
+                thread_num = std::max(1, std::stoi(argv[++i]));
+            } else {
+                return usage();
+            }
+        }
+        WordCounter counter(thread_num, calculate_actual);
         counter.process_file(argv[1]);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << '\n';
@@ -161,4 +138,4 @@ int main(int argc, char* argv[]) {
     }
 
     return 0;
-} 
\ No newline at end of file
+} 
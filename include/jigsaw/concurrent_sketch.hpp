@@ -0,0 +1,348 @@
+#pragma once
+#include "sketch.hpp"
+#include <atomic>
+#include <immintrin.h>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace jigsaw {
+
+// Sketch variant that many producer threads can update at once.
+//  - each cell is one 64-bit word (fp << 32 | counter): matched cells are
+//    bumped with a saturating CAS loop, replacements and heavy/light swaps
+//    use CAS
+//  - each heavy slot owns its left-part words (no bit packing across slots)
+//    behind a seqlock. A heavy cell only changes occupant under its slot's
+//    lock, together with the left part, so readers copying both inside the
+//    seqlock never pair one flow's fingerprint with another's left part.
+// Increments racing with a replacement of the same cell may land on the new
+// occupant, which inherits the counter anyway as in the sequential sketch.
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL>
+class ConcurrentSketch {
+public:
+    struct FlowInfo {
+        KeyType key;
+        uint32_t count;
+
+        bool operator<(const FlowInfo& other) const {
+            return count > other.count;
+        }
+    };
+
+    ConcurrentSketch()
+        : cells_(new std::atomic<uint64_t>[size_t(BucketNum) * CELL_NUM]),
+          slots_(new Slot[size_t(BucketNum) * CellNumH]) {
+        for (size_t i = 0; i < size_t(BucketNum) * CELL_NUM; i++) {
+            cells_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void insert(const KeyType& key) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[LEFT_PART_WORDS] = {0};
+        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+
+        while (!try_insert(bucket_idx, fp, left_part)) {
+            _mm_pause();
+        }
+    }
+
+    uint32_t query(const KeyType& key) const {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[LEFT_PART_WORDS] = {0};
+        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+
+        const std::atomic<uint64_t>* bucket = &cells_[size_t(bucket_idx) * CELL_NUM];
+        for (uint32_t i = 0; i < CellNumH; i++) {
+            if (cell_fp(bucket[i].load(std::memory_order_acquire)) == fp) {
+                uint64_t target_left_part[LEFT_PART_WORDS];
+                uint64_t word = read_heavy(bucket_idx, i, target_left_part);
+                if (cell_fp(word) == fp && same_left_part(left_part, target_left_part)) {
+                    return cell_count(word);
+                }
+            }
+        }
+        for (uint32_t i = CellNumH; i < CELL_NUM; i++) {
+            uint64_t word = bucket[i].load(std::memory_order_acquire);
+            if (cell_fp(word) == fp) {
+                return cell_count(word);
+            }
+        }
+        return 0;
+    }
+
+    std::vector<FlowInfo> get_heavy_flows() const {
+        std::vector<FlowInfo> flows;
+        for (uint32_t bucket_idx = 0; bucket_idx < BucketNum; bucket_idx++) {
+            for (uint32_t i = 0; i < CellNumH; i++) {
+                uint64_t left_part[LEFT_PART_WORDS];
+                uint64_t word = read_heavy(bucket_idx, i, left_part);
+                if (cell_count(word) > 0) {
+                    FlowInfo flow;
+                    KeyHasher<KeyType, BucketNum>::combine_key(flow.key, bucket_idx, cell_fp(word), left_part);
+                    flow.count = cell_count(word);
+                    flows.push_back(flow);
+                }
+            }
+        }
+
+        std::sort(flows.begin(), flows.end());
+        return flows;
+    }
+
+private:
+    static constexpr uint32_t CELL_NUM = CellNumH + CellNumL;
+    static constexpr uint32_t SLOT_BITS = LeftPartBits + Config::EXTRA_BITS_NUM;
+    static constexpr uint32_t LEFT_PART_WORDS =
+        std::max<uint32_t>({2, (SLOT_BITS + 63) / 64, KeyHasher<KeyType, BucketNum>::LEFT_PART_WORDS});
+
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint64_t> words[LEFT_PART_WORDS] = {};
+    };
+
+    std::unique_ptr<std::atomic<uint64_t>[]> cells_;
+    std::unique_ptr<Slot[]> slots_;
+
+    static uint64_t make_cell(uint16_t fp, uint32_t c) { return (uint64_t(fp) << 32) | c; }
+    static uint16_t cell_fp(uint64_t word) { return static_cast<uint16_t>(word >> 32); }
+    static uint32_t cell_count(uint64_t word) { return static_cast<uint32_t>(word); }
+
+    // Adds one unless the counter is saturated, so it never carries into the
+    // fingerprint; returns the new count
+    static uint32_t increment(std::atomic<uint64_t>& cell) {
+        uint64_t word = cell.load(std::memory_order_relaxed);
+        while (cell_count(word) != UINT32_MAX &&
+               !cell.compare_exchange_weak(word, word + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+        }
+        return cell_count(word) == UINT32_MAX ? UINT32_MAX : cell_count(word) + 1;
+    }
+
+    static WyRand& rng() {
+        thread_local WyRand generator((uint64_t(std::random_device{}()) << 32) | std::random_device{}());
+        return generator;
+    }
+
+    Slot& slot_of(uint32_t bucket_idx, uint32_t i) const {
+        return slots_[size_t(bucket_idx) * CellNumH + i];
+    }
+
+    // Left parts compare on the stored LeftPartBits only
+    static bool same_left_part(const uint64_t* a, const uint64_t* b) {
+        for (uint32_t w = 0; w < LEFT_PART_WORDS; w++) {
+            uint32_t lo = w * 64;
+            if (lo >= LeftPartBits) break;
+            uint64_t mask = LeftPartBits - lo >= 64 ? ~0ULL : ((1ULL << (LeftPartBits - lo)) - 1);
+            if ((a[w] ^ b[w]) & mask) return false;
+        }
+        return true;
+    }
+
+    // Seqlock writer side; the sequence is odd while a writer holds the slot
+    static uint32_t lock_slot(Slot& slot) {
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        while ((seq & 1) || !slot.seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire,
+                                                            std::memory_order_relaxed)) {
+            _mm_pause();
+            seq = slot.seq.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return seq;
+    }
+
+    static void unlock_slot(Slot& slot, uint32_t seq) {
+        slot.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // The extra counter sits right above the left part and may straddle a
+    // word boundary
+    static constexpr uint32_t COUNTER_WORD = LeftPartBits / 64;
+    static constexpr uint32_t COUNTER_SHIFT = LeftPartBits % 64;
+    static constexpr uint64_t COUNTER_MASK = (1u << Config::EXTRA_BITS_NUM) - 1;
+    static constexpr bool COUNTER_SPLIT = COUNTER_SHIFT + Config::EXTRA_BITS_NUM > 64;
+
+    // Copies the left part with the bits at and above LeftPartBits cleared,
+    // as SlotCodec does, and returns the extra counter
+    static uint8_t load_words(const Slot& slot, uint64_t* left_part) {
+        uint64_t words[LEFT_PART_WORDS];
+        for (uint32_t w = 0; w < LEFT_PART_WORDS; w++) {
+            words[w] = slot.words[w].load(std::memory_order_relaxed);
+        }
+        uint64_t counter = words[COUNTER_WORD] >> COUNTER_SHIFT;
+        if constexpr (COUNTER_SPLIT) {
+            counter |= words[COUNTER_WORD + 1] << (64 - COUNTER_SHIFT);
+        }
+        for (uint32_t w = 0; w < LEFT_PART_WORDS; w++) {
+            uint32_t lo = w * 64;
+            if (lo >= LeftPartBits) {
+                left_part[w] = 0;
+                continue;
+            }
+            uint64_t mask = LeftPartBits - lo >= 64 ? ~0ULL : ((1ULL << (LeftPartBits - lo)) - 1);
+            left_part[w] = words[w] & mask;
+        }
+        return static_cast<uint8_t>(counter & COUNTER_MASK);
+    }
+
+    // Seqlock reader side: retry until a stable, even sequence brackets the
+    // copy of the heavy cell and its left part. Counts may move meanwhile,
+    // the occupant may not.
+    uint64_t read_heavy(uint32_t bucket_idx, uint32_t i, uint64_t* left_part) const {
+        const Slot& slot = slot_of(bucket_idx, i);
+        const std::atomic<uint64_t>& cell = cells_[size_t(bucket_idx) * CELL_NUM + i];
+        for (;;) {
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                _mm_pause();
+                continue;
+            }
+            uint64_t word = cell.load(std::memory_order_acquire);
+            load_words(slot, left_part);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == seq) {
+                return word;
+            }
+        }
+    }
+
+    // Writes LeftPartBits of left_part and keeps the slot's extra counter bits
+    static void store_left_part(Slot& slot, const uint64_t* left_part) {
+        for (uint32_t w = 0; w < LEFT_PART_WORDS; w++) {
+            uint32_t lo = w * 64;
+            if (lo >= LeftPartBits) break;
+            uint64_t mask = LeftPartBits - lo >= 64 ? ~0ULL : ((1ULL << (LeftPartBits - lo)) - 1);
+            uint64_t word = slot.words[w].load(std::memory_order_relaxed);
+            slot.words[w].store((word & ~mask) | (left_part[w] & mask), std::memory_order_relaxed);
+        }
+    }
+
+    static void store_counter(Slot& slot, uint8_t counter) {
+        constexpr uint64_t mask = COUNTER_MASK << COUNTER_SHIFT;
+        uint64_t word = slot.words[COUNTER_WORD].load(std::memory_order_relaxed);
+        slot.words[COUNTER_WORD].store((word & ~mask) | (uint64_t(counter) << COUNTER_SHIFT),
+                                       std::memory_order_relaxed);
+        if constexpr (COUNTER_SPLIT) {
+            constexpr uint64_t high_mask = COUNTER_MASK >> (64 - COUNTER_SHIFT);
+            uint64_t high = slot.words[COUNTER_WORD + 1].load(std::memory_order_relaxed);
+            slot.words[COUNTER_WORD + 1].store((high & ~high_mask) | (uint64_t(counter) >> (64 - COUNTER_SHIFT)),
+                                               std::memory_order_relaxed);
+        }
+    }
+
+    // Hands heavy cell i to a new occupant: the CAS and the left part write
+    // happen under the slot lock, so readers see both or neither
+    bool replace_heavy(uint32_t bucket_idx, uint32_t i, uint64_t expected, uint64_t desired,
+                       const uint64_t* left_part) {
+        Slot& slot = slot_of(bucket_idx, i);
+        uint32_t seq = lock_slot(slot);
+        bool replaced = cells_[size_t(bucket_idx) * CELL_NUM + i].compare_exchange_strong(expected, desired);
+        if (replaced) {
+            store_left_part(slot, left_part);
+        }
+        unlock_slot(slot, seq);
+        return replaced;
+    }
+
+    // Same decision as Sketch::insert at the 512 threshold, done under the
+    // slot lock so concurrent verifications serialize. Skipped if the flow
+    // lost the cell since its increment.
+    void verify_left_part(uint32_t bucket_idx, uint32_t i, uint16_t fp, const uint64_t* left_part) {
+        Slot& slot = slot_of(bucket_idx, i);
+        uint32_t seq = lock_slot(slot);
+        if (cell_fp(cells_[size_t(bucket_idx) * CELL_NUM + i].load(std::memory_order_relaxed)) != fp) {
+            unlock_slot(slot, seq);
+            return;
+        }
+        uint64_t target_left_part[LEFT_PART_WORDS];
+        uint8_t extra_counter = load_words(slot, target_left_part);
+        if (!same_left_part(left_part, target_left_part)) {
+            if (extra_counter > 0) {
+                store_counter(slot, extra_counter - 1);
+            } else {
+                store_left_part(slot, left_part);
+            }
+        } else if (extra_counter != (1 << Config::EXTRA_BITS_NUM) - 1) {
+            store_counter(slot, extra_counter + 1);
+        }
+        unlock_slot(slot, seq);
+    }
+
+    // One pass of the sequential insert; false when a CAS lost a race and the
+    // bucket has to be probed again
+    bool try_insert(uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+        std::atomic<uint64_t>* bucket = &cells_[size_t(bucket_idx) * CELL_NUM];
+        uint64_t words[CELL_NUM];
+
+        uint32_t smallest_heavy_idx = 0;
+        uint32_t smallest_heavy_counter = UINT32_MAX;
+
+        for (uint32_t i = 0; i < CellNumH; i++) {
+            words[i] = bucket[i].load(std::memory_order_acquire);
+            if (cell_count(words[i]) == 0) {
+                return replace_heavy(bucket_idx, i, words[i], make_cell(fp, 1), left_part);
+            }
+            if (cell_fp(words[i]) == fp) {
+                uint32_t counter = increment(bucket[i]);
+                if (counter == 512 || (counter > 512 && (rng()() & 511) == 0)) {
+                    verify_left_part(bucket_idx, i, fp, left_part);
+                }
+                return true;
+            }
+            if (cell_count(words[i]) < smallest_heavy_counter) {
+                smallest_heavy_idx = i;
+                smallest_heavy_counter = cell_count(words[i]);
+            }
+        }
+
+        uint32_t smallest_idx = smallest_heavy_idx;
+        uint32_t smallest_counter = smallest_heavy_counter;
+
+        for (uint32_t i = CellNumH; i < CELL_NUM; i++) {
+            words[i] = bucket[i].load(std::memory_order_acquire);
+            if (cell_count(words[i]) == 0) {
+                return bucket[i].compare_exchange_strong(words[i], make_cell(fp, 1));
+            }
+            if (cell_fp(words[i]) == fp) {
+                uint32_t matched_counter = cell_count(words[i]);
+                if (matched_counter < smallest_heavy_counter) {
+                    increment(bucket[i]);
+                    return true;
+                }
+
+                // Promote: claim the smallest heavy cell first, then hand the
+                // light cell to the demoted flow if nobody replaced it meanwhile
+                const uint32_t promoted_counter = matched_counter == UINT32_MAX ? UINT32_MAX : matched_counter + 1;
+                if (!replace_heavy(bucket_idx, smallest_heavy_idx, words[smallest_heavy_idx],
+                                   make_cell(fp, promoted_counter), left_part)) {
+                    return false;
+                }
+                uint64_t light_word = bucket[i].load(std::memory_order_acquire);
+                while (cell_fp(light_word) == fp &&
+                       !bucket[i].compare_exchange_weak(light_word, words[smallest_heavy_idx])) {
+                }
+                return true;
+            }
+            if (cell_count(words[i]) < smallest_counter) {
+                smallest_idx = i;
+                smallest_counter = cell_count(words[i]);
+            }
+        }
+
+        if (one_in(static_cast<uint32_t>(rng()()), smallest_counter)) {
+            if (smallest_idx < CellNumH) {
+                return replace_heavy(bucket_idx, smallest_idx, words[smallest_idx],
+                                     make_cell(fp, smallest_counter), left_part);
+            }
+            uint64_t expected = words[smallest_idx];
+            if (!bucket[smallest_idx].compare_exchange_strong(expected, make_cell(fp, smallest_counter))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace jigsaw
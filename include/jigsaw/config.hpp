@@ -4,7 +4,6 @@
 namespace jigsaw {
 
 struct Config {
-    static constexpr size_t KEY_SIZE = 32;  // Large enough for IPv6 by default
     static constexpr uint32_t MASK_26BITS = 0x3FFFFFF;
     static constexpr unsigned int EXTRA_BITS_NUM = 2;
     
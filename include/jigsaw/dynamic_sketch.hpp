@@ -0,0 +1,348 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "sketch.hpp"
+#include "utils/allocator.hpp"
+#include "utils/auxiliary_list.hpp"
+#include "utils/fast_range.hpp"
+#include "utils/random.hpp"
+#include "utils/simd.hpp"
+
+namespace jigsaw {
+
+struct DynamicSketchConfig {
+    uint32_t bucket_num = 4096;
+    uint32_t left_part_bits = 79;
+    uint32_t cell_num_h = 16;
+    uint32_t cell_num_l = 16;
+    bool huge_pages = false;   // back bucket and auxiliary storage with 2 MB pages
+    uint64_t seed = 0;         // replacement RNG seed; 0 seeds from the clock
+};
+
+// Sketch whose dimensions are chosen at construction time. Storage lives on
+// the heap (optionally on huge pages), so even the largest configurations
+// can be declared locally and resized without recompiling. The compile-time
+// Sketch remains the faster choice when the dimensions are fixed.
+//
+// Each bucket is one cache-line aligned block of fingerprints followed by
+// counters; the heavy and light parts are padded to whole SIMD chunks so
+// probes run the same vector compares as SoALayout with runtime bounds.
+template<typename KeyType>
+class DynamicSketch {
+public:
+    struct FlowInfo {
+        KeyType key;
+        uint32_t count;
+
+        bool operator<(const FlowInfo& other) const {
+            return count > other.count;
+        }
+    };
+
+    explicit DynamicSketch(const DynamicSketchConfig& config = {})
+        : bucket_num_(config.bucket_num),
+          left_part_bits_(config.left_part_bits),
+          cell_num_h_(config.cell_num_h),
+          cell_num_l_(config.cell_num_l),
+          light_begin_(round_up(config.cell_num_h, CHUNK)),
+          lanes_(light_begin_ + round_up(config.cell_num_l, CHUNK)),
+          bucket_bytes_(round_up(lanes_ * (sizeof(uint16_t) + sizeof(uint32_t)), 64)),
+          bucket_index_(std::max<uint32_t>(config.bucket_num, 1)),
+          rng_(config.seed ? config.seed : std::chrono::steady_clock::now().time_since_epoch().count()) {
+        if (bucket_num_ == 0 || cell_num_h_ == 0 || cell_num_l_ == 0) {
+            throw std::invalid_argument("DynamicSketch needs at least one bucket and one cell per part");
+        }
+        if (left_part_bits_ == 0 || left_part_bits_ + Config::EXTRA_BITS_NUM > 128) {
+            throw std::invalid_argument("DynamicSketch left part must be 1 to 126 bits");
+        }
+
+        buckets_ = AlignedBuffer<uint8_t>(uint64_t(bucket_num_) * bucket_bytes_, config.huge_pages);
+        auxiliary_list_ = AlignedBuffer<uint64_t>(
+            auxiliary::word_num(left_part_bits_, uint64_t(bucket_num_) * cell_num_h_), config.huge_pages);
+
+        // Padding lanes hold the largest counter so they never look empty
+        // and never win a min-reduction
+        for (uint32_t bucket_idx = 0; bucket_idx < bucket_num_; bucket_idx++) {
+            uint32_t* c = counters(bucket_idx);
+            std::fill(c + cell_num_h_, c + light_begin_, UINT32_MAX);
+            std::fill(c + light_begin_ + cell_num_l_, c + lanes_, UINT32_MAX);
+        }
+    }
+
+    void insert(const KeyType& key) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[LEFT_PART_WORDS] = {0};
+        divide_key(key, bucket_idx, fp, left_part);
+        update(bucket_idx, fp, left_part);
+    }
+
+    void insert_batch(const KeyType* keys, size_t n) {
+        for (size_t base = 0; base < n; base += MAX_BATCH) {
+            size_t batch = std::min(n - base, MAX_BATCH);
+            uint32_t bucket_idx[MAX_BATCH];
+            uint16_t fp[MAX_BATCH];
+            uint64_t left_part[MAX_BATCH][LEFT_PART_WORDS];
+
+            for (size_t i = 0; i < batch; i++) {
+                std::fill_n(left_part[i], LEFT_PART_WORDS, 0);
+                divide_key(keys[base + i], bucket_idx[i], fp[i], left_part[i]);
+                prefetch_bucket(bucket_idx[i]);
+            }
+            for (size_t i = 0; i < batch; i++) {
+                update(bucket_idx[i], fp[i], left_part[i]);
+            }
+        }
+    }
+
+    uint32_t query(const KeyType& key) const {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[LEFT_PART_WORDS] = {0};
+        divide_key(key, bucket_idx, fp, left_part);
+
+        const uint16_t* f = fps(bucket_idx);
+        const uint32_t* c = counters(bucket_idx);
+        for (uint32_t chunk = 0; chunk < cell_num_h_; chunk += CHUNK) {
+            uint64_t mask = simd::match_epi16<CHUNK>(f + chunk, fp) & lane_mask(cell_num_h_ - chunk);
+            for (; mask; mask &= mask - 1) {
+                uint32_t i = chunk + static_cast<uint32_t>(__builtin_ctzll(mask));
+                uint64_t target_left_part[LEFT_PART_WORDS] = {0};
+                get_left_part(uint64_t(bucket_idx) * cell_num_h_ + i, target_left_part);
+                if (auxiliary::same_left_part(left_part, target_left_part, left_part_bits_)) {
+                    return c[i];
+                }
+            }
+        }
+
+        for (uint32_t chunk = 0; chunk < cell_num_l_; chunk += CHUNK) {
+            uint64_t mask = simd::match_epi16<CHUNK>(f + light_begin_ + chunk, fp) & lane_mask(cell_num_l_ - chunk);
+            if (mask) {
+                return c[light_begin_ + chunk + __builtin_ctzll(mask)];
+            }
+        }
+        return 0;
+    }
+
+    std::vector<FlowInfo> get_heavy_flows() const {
+        std::vector<FlowInfo> flows;
+        flows.reserve(uint64_t(bucket_num_) * cell_num_h_);
+
+        for (uint32_t bucket_idx = 0; bucket_idx < bucket_num_; bucket_idx++) {
+            const uint16_t* f = fps(bucket_idx);
+            const uint32_t* c = counters(bucket_idx);
+            for (uint32_t i = 0; i < cell_num_h_; i++) {
+                if (c[i] > 0) {
+                    FlowInfo flow;
+                    uint64_t left_part[LEFT_PART_WORDS] = {0};
+                    get_left_part(uint64_t(bucket_idx) * cell_num_h_ + i, left_part);
+                    Hasher::combine_key(flow.key, bucket_idx, f[i], left_part);
+                    flow.count = c[i];
+                    flows.push_back(flow);
+                }
+            }
+        }
+
+        std::sort(flows.begin(), flows.end());
+        return flows;
+    }
+
+    uint32_t bucket_num() const { return bucket_num_; }
+    uint32_t left_part_bits() const { return left_part_bits_; }
+    uint32_t cell_num_h() const { return cell_num_h_; }
+    uint32_t cell_num_l() const { return cell_num_l_; }
+    bool huge_tlb() const { return buckets_.huge_tlb(); }
+
+    size_t memory_usage() const {
+        return buckets_.size() + auxiliary_list_.size() * sizeof(uint64_t);
+    }
+
+private:
+    // hash() does not depend on the bucket count; the reduction happens here
+    using Hasher = KeyHasher<KeyType, 1>;
+
+    // Runtime slots hold at most two words; longer keys still hash in full
+    static constexpr uint32_t LEFT_PART_WORDS = std::max<uint32_t>(2, Hasher::LEFT_PART_WORDS);
+
+    static constexpr uint32_t CHUNK = 16;   // lanes per SIMD probe
+    static constexpr size_t MAX_BATCH = 256;
+
+    static uint32_t round_up(uint32_t n, uint32_t multiple) {
+        return (n + multiple - 1) / multiple * multiple;
+    }
+
+    static uint64_t lane_mask(uint32_t remaining) {
+        return remaining >= CHUNK ? (uint64_t(1) << CHUNK) - 1 : (uint64_t(1) << remaining) - 1;
+    }
+
+    void divide_key(const KeyType& key, uint32_t& bucket_idx, uint16_t& fp, uint64_t* left_part) const {
+        bucket_idx = bucket_index_(Hasher::hash(key, fp, left_part));
+    }
+
+    uint16_t* fps(uint32_t bucket_idx) {
+        return reinterpret_cast<uint16_t*>(buckets_.data() + uint64_t(bucket_idx) * bucket_bytes_);
+    }
+    const uint16_t* fps(uint32_t bucket_idx) const {
+        return reinterpret_cast<const uint16_t*>(buckets_.data() + uint64_t(bucket_idx) * bucket_bytes_);
+    }
+    uint32_t* counters(uint32_t bucket_idx) {
+        return reinterpret_cast<uint32_t*>(buckets_.data() + uint64_t(bucket_idx) * bucket_bytes_ +
+                                           lanes_ * sizeof(uint16_t));
+    }
+    const uint32_t* counters(uint32_t bucket_idx) const {
+        return reinterpret_cast<const uint32_t*>(buckets_.data() + uint64_t(bucket_idx) * bucket_bytes_ +
+                                                 lanes_ * sizeof(uint16_t));
+    }
+
+    uint8_t get_left_part(uint64_t slot_idx, uint64_t* left_part) const {
+        return auxiliary::get_left_part(auxiliary_list_.data(), left_part_bits_, slot_idx, left_part);
+    }
+
+    void set_left_part(uint64_t slot_idx, const uint64_t* left_part) {
+        auxiliary::set_left_part(auxiliary_list_.data(), left_part_bits_, slot_idx, left_part);
+    }
+
+    void set_left_part_counter(uint64_t slot_idx, uint8_t counter) {
+        auxiliary::set_extra_counter(auxiliary_list_.data(), left_part_bits_, slot_idx, counter);
+    }
+
+    // First lane in [begin, begin + num) that is empty or holds fp, else num
+    uint32_t find(const uint16_t* f, const uint32_t* c, uint32_t begin, uint32_t num, uint16_t fp) const {
+        for (uint32_t chunk = 0; chunk < num; chunk += CHUNK) {
+            uint64_t mask = (simd::match_epi16<CHUNK>(f + begin + chunk, fp) |
+                             simd::match_epi32<CHUNK>(c + begin + chunk, 0)) & lane_mask(num - chunk);
+            if (mask) {
+                return chunk + static_cast<uint32_t>(__builtin_ctzll(mask));
+            }
+        }
+        return num;
+    }
+
+    // First lane in [begin, begin + num) with the smallest counter
+    uint32_t smallest(const uint32_t* c, uint32_t begin, uint32_t num) const {
+        uint32_t smallest_idx = 0;
+        uint64_t smallest_counter = UINT64_MAX;
+        for (uint32_t chunk = 0; chunk < num; chunk += CHUNK) {
+            uint32_t chunk_min = simd::min_epu32<CHUNK>(c + begin + chunk);
+            if (chunk_min < smallest_counter) {
+                uint64_t mask = simd::match_epi32<CHUNK>(c + begin + chunk, chunk_min) & lane_mask(num - chunk);
+                if (mask) {
+                    smallest_counter = chunk_min;
+                    smallest_idx = chunk + static_cast<uint32_t>(__builtin_ctzll(mask));
+                }
+            }
+        }
+        return smallest_idx;
+    }
+
+    void prefetch_bucket(uint32_t bucket_idx) const {
+        const uint8_t* bucket = buckets_.data() + uint64_t(bucket_idx) * bucket_bytes_;
+        for (uint32_t offset = 0; offset < bucket_bytes_; offset += 64) {
+            __builtin_prefetch(bucket + offset, 1);
+        }
+        uint64_t bit_idx = uint64_t(bucket_idx) * cell_num_h_ * (left_part_bits_ + Config::EXTRA_BITS_NUM);
+        __builtin_prefetch(auxiliary_list_.data() + bit_idx / 64, 1);
+    }
+
+    // Same update rule as Sketch::update, with runtime cell counts
+    void update(uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+        uint16_t* f = fps(bucket_idx);
+        uint32_t* c = counters(bucket_idx);
+        const uint64_t slot_base = uint64_t(bucket_idx) * cell_num_h_;
+        const uint32_t light_end = light_begin_ + cell_num_l_;
+
+        // Check heavy cells: the first empty or matching cell wins
+        uint32_t matched_idx = find(f, c, 0, cell_num_h_, fp);
+        if (matched_idx < cell_num_h_ && c[matched_idx] == 0) {
+            f[matched_idx] = fp;
+            c[matched_idx] = 1;
+            set_left_part(slot_base + matched_idx, left_part);
+            return;
+        }
+
+        uint32_t smallest_heavy_idx = 0;
+        uint32_t smallest_heavy_counter = UINT32_MAX;
+
+        if (matched_idx == cell_num_h_) {
+            smallest_heavy_idx = smallest(c, 0, cell_num_h_);
+            smallest_heavy_counter = c[smallest_heavy_idx];
+
+            matched_idx = light_begin_ + find(f, c, light_begin_, cell_num_l_, fp);
+            if (matched_idx < light_end && c[matched_idx] == 0) {
+                f[matched_idx] = fp;
+                c[matched_idx] = 1;
+                return;
+            }
+        }
+
+        if (matched_idx == light_end) {
+            uint32_t smallest_idx = smallest_heavy_idx;
+            uint32_t smallest_counter = smallest_heavy_counter;
+            uint32_t smallest_light_idx = light_begin_ + smallest(c, light_begin_, cell_num_l_);
+            if (c[smallest_light_idx] < smallest_counter) {
+                smallest_idx = smallest_light_idx;
+                smallest_counter = c[smallest_light_idx];
+            }
+
+            if (one_in(static_cast<uint32_t>(rng_()), smallest_counter)) {
+                f[smallest_idx] = fp;
+                if (smallest_idx < cell_num_h_) {
+                    set_left_part(slot_base + smallest_idx, left_part);
+                }
+            }
+            return;
+        }
+
+        uint32_t matched_counter = c[matched_idx];
+
+        if (matched_idx >= light_begin_) {
+            if (matched_counter >= smallest_heavy_counter) {
+                f[matched_idx] = f[smallest_heavy_idx];
+                c[matched_idx] = smallest_heavy_counter;
+                f[smallest_heavy_idx] = fp;
+                c[smallest_heavy_idx] = matched_counter + 1;
+
+                set_left_part(slot_base + smallest_heavy_idx, left_part);
+                return;
+            }
+        }
+
+        c[matched_idx] = ++matched_counter;
+
+        if (matched_idx < cell_num_h_ &&
+            (matched_counter == 512 || (matched_counter > 512 && (rng_() & 511) == 0))) {
+
+            uint64_t slot_idx = slot_base + matched_idx;
+            uint64_t target_left_part[LEFT_PART_WORDS] = {0};
+            uint8_t extra_counter = get_left_part(slot_idx, target_left_part);
+
+            if (!auxiliary::same_left_part(left_part, target_left_part, left_part_bits_)) {
+                if (extra_counter > 0) {
+                    set_left_part_counter(slot_idx, extra_counter - 1);
+                } else {
+                    set_left_part(slot_idx, left_part);
+                }
+            } else if (extra_counter != (1 << Config::EXTRA_BITS_NUM) - 1) {
+                set_left_part_counter(slot_idx, extra_counter + 1);
+            }
+        }
+    }
+
+    uint32_t bucket_num_;
+    uint32_t left_part_bits_;
+    uint32_t cell_num_h_;
+    uint32_t cell_num_l_;
+    uint32_t light_begin_;    // first light lane; heavy lanes are padded to CHUNK
+    uint32_t lanes_;          // padded lanes per bucket
+    uint32_t bucket_bytes_;   // fingerprints then counters, rounded to a cache line
+    FastMod bucket_index_;    // hash % bucket_num_ without a hardware divide
+
+    AlignedBuffer<uint8_t> buckets_;
+    AlignedBuffer<uint64_t> auxiliary_list_;
+    WyRand rng_;
+};
+
+} // namespace jigsaw
@@ -0,0 +1,82 @@
+#pragma once
+#include "sketch.hpp"
+#include <atomic>
+#include <immintrin.h>
+#include <memory>
+
+namespace jigsaw {
+
+// Two sketches used in turn for periodic export: the ingestion thread always
+// writes to the active one, and an exporter thread flips them, reads the
+// retired sketch at leisure and clears it for its next turn.
+//
+// Ingestion never waits for an export. Before touching a sketch the writer
+// announces the epoch it is working in and re-checks that the epoch is
+// still current, retrying otherwise; the exporter flips the epoch and then
+// waits only for a batch already in flight on the retired sketch, so no
+// insert is lost or split across exports.
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout>
+class EpochSketch {
+public:
+    using SketchType = Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout>;
+    using FlowInfo = typename SketchType::FlowInfo;
+
+    EpochSketch() : sketches_{std::make_unique<SketchType>(), std::make_unique<SketchType>()} {}
+
+    // Ingestion side: a single thread at a time
+
+    void insert(const KeyType& key) {
+        insert_batch(&key, 1);
+    }
+
+    void insert_batch(const KeyType* keys, size_t n) {
+        uint64_t epoch = enter();
+        sketches_[epoch & 1]->insert_batch(keys, n);
+        in_flight_.store(idle(epoch), std::memory_order_release);
+    }
+
+    // Epochs exported so far
+    uint64_t epoch() const { return epoch_.load(std::memory_order_acquire); }
+
+    // Exporter side: a single thread at a time.
+    //
+    // Makes the other sketch active, waits for an insert batch still running
+    // on the retired one, passes the retired sketch to export_fn (e.g. to
+    // call get_heavy_flows or top_k) and clears it with non-temporal stores.
+    template<typename ExportFn>
+    void export_epoch(ExportFn&& export_fn) {
+        uint64_t retired = epoch_.load(std::memory_order_relaxed);
+        epoch_.store(retired + 1, std::memory_order_seq_cst);
+        while (in_flight_.load(std::memory_order_seq_cst) == busy(retired)) {
+            _mm_pause();
+        }
+
+        SketchType& sketch = *sketches_[retired & 1];
+        export_fn(static_cast<const SketchType&>(sketch));
+        sketch.clear();
+    }
+
+private:
+    // in_flight_ holds busy(epoch) while the writer works in that epoch
+    static uint64_t busy(uint64_t epoch) { return 2 * epoch + 1; }
+    static uint64_t idle(uint64_t epoch) { return 2 * epoch; }
+
+    uint64_t enter() {
+        for (;;) {
+            uint64_t epoch = epoch_.load(std::memory_order_acquire);
+            // Pairs with the exporter's flip then check: either it sees this
+            // epoch busy and waits, or this re-check sees the flip
+            in_flight_.store(busy(epoch), std::memory_order_seq_cst);
+            if (epoch_.load(std::memory_order_seq_cst) == epoch) {
+                return epoch;
+            }
+        }
+    }
+
+    std::unique_ptr<SketchType> sketches_[2];
+    alignas(64) std::atomic<uint64_t> epoch_{0};
+    alignas(64) std::atomic<uint64_t> in_flight_{0};
+};
+
+} // namespace jigsaw
@@ -0,0 +1,133 @@
+#pragma once
+#include "sketch.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <xxhash.h>
+
+namespace jigsaw {
+
+// Sketch over strings of any length. Each string is counted under its
+// 128-bit XXH3 hash, a GenericKey<16> the sketch stores exactly, and the
+// text itself is copied into a dictionary only once the string reaches a
+// heavy cell. Dictionary memory thus follows the heavy part (it is pruned
+// back to the heavy flows whenever it outgrows twice their number), not
+// the number of distinct strings; two strings are confused only if their
+// 128-bit hashes collide.
+template<uint32_t BucketNum, uint32_t CellNumH, uint32_t CellNumL, typename Layout = AoSLayout>
+class InternedStringSketch {
+public:
+    using HashKey = GenericKey<16>;
+    using SketchType =
+        Sketch<HashKey, BucketNum, KeyHasher<HashKey, BucketNum>::LEFT_PART_BITS, CellNumH, CellNumL, Layout>;
+    static_assert(SketchType::EXACT_KEYS, "heavy hashes must decode to look up their strings");
+
+    struct StringInfo {
+        std::string key;
+        uint32_t count;
+
+        bool operator<(const StringInfo& other) const {
+            return count > other.count;
+        }
+    };
+
+    InternedStringSketch() : sketch_(std::make_unique<SketchType>()) {}
+
+    // Fixed seed for reproducible replacement decisions
+    explicit InternedStringSketch(uint64_t seed) : sketch_(std::make_unique<SketchType>(seed)) {}
+
+    // Returns the string's heavy counter after the insert, as Sketch::insert
+    uint32_t insert(std::string_view key) {
+        const HashKey hash = hash_key(key);
+        const uint32_t count = sketch_->insert(hash);
+        if (count > 0) {
+            intern(hash, key);
+        }
+        return count;
+    }
+
+    // Hash the batch up front and prefetch its buckets, as Sketch::insert_batch
+    void insert_batch(const std::string_view* keys, size_t n) {
+        hashes_.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            hashes_[i] = hash_key(keys[i]);
+        }
+        sketch_->for_each_hashed(hashes_.data(), n,
+                                 [&](size_t i, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            if (sketch_->insert_hashed(bucket_idx, fp, left_part) > 0) {
+                intern(hashes_[i], keys[i]);
+            }
+        });
+    }
+
+    uint32_t query(std::string_view key) const {
+        return sketch_->query(hash_key(key));
+    }
+
+    // Heavy strings, largest first
+    std::vector<StringInfo> get_heavy_flows() const {
+        std::vector<StringInfo> strings;
+        for (const auto& flow : sketch_->get_heavy_flows()) {
+            auto it = dictionary_.find(flow.key);
+            if (it != dictionary_.end()) {
+                strings.push_back({it->second, flow.count});
+            }
+        }
+        return strings;
+    }
+
+    size_t dictionary_size() const { return dictionary_.size(); }
+
+    const SketchType& sketch() const { return *sketch_; }
+
+private:
+    static constexpr size_t HEAVY_CELL_NUM = size_t(BucketNum) * CellNumH;
+
+    struct HashKeyHash {
+        size_t operator()(const HashKey& key) const {
+            uint64_t low;
+            std::memcpy(&low, key.data, sizeof(low));
+            return static_cast<size_t>(low);
+        }
+    };
+
+    struct HashKeyEqual {
+        bool operator()(const HashKey& a, const HashKey& b) const {
+            return std::memcmp(a.data, b.data, HashKey::SIZE) == 0;
+        }
+    };
+
+    static HashKey hash_key(std::string_view key) {
+        const XXH128_hash_t hash = XXH3_128bits(key.data(), key.size());
+        HashKey hash_key;
+        std::memcpy(hash_key.data, &hash.low64, 8);
+        std::memcpy(hash_key.data + 8, &hash.high64, 8);
+        return hash_key;
+    }
+
+    void intern(const HashKey& hash, std::string_view key) {
+        if (dictionary_.try_emplace(hash, key).second && dictionary_.size() > 2 * HEAVY_CELL_NUM) {
+            prune();
+        }
+    }
+
+    // Drop strings whose hashes have since left the heavy cells
+    void prune() {
+        std::unordered_set<HashKey, HashKeyHash, HashKeyEqual> heavy;
+        for (const auto& flow : sketch_->get_heavy_flows()) {
+            heavy.insert(flow.key);
+        }
+        for (auto it = dictionary_.begin(); it != dictionary_.end();) {
+            it = heavy.count(it->first) ? std::next(it) : dictionary_.erase(it);
+        }
+    }
+
+    std::unique_ptr<SketchType> sketch_;
+    std::unordered_map<HashKey, std::string, HashKeyHash, HashKeyEqual> dictionary_;
+    std::vector<HashKey> hashes_;  // insert_batch scratch, reused across batches
+};
+
+} // namespace jigsaw
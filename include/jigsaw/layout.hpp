@@ -0,0 +1,256 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "utils/simd.hpp"
+
+namespace jigsaw {
+
+// Bucket layouts for Sketch. Each layout provides a Bucket<CellNumH, CellNumL>
+// holding CellNumH heavy cells followed by CellNumL light cells, and the probe
+// primitives the sketch uses on the per-packet path:
+//   find<Begin, End>(fp)   first cell in [Begin, End) that is empty or holds fp, else End
+//   match<Begin, End>(fp)  bitmask of cells in [Begin, End) holding fp
+//   smallest<Begin, End>() first cell in [Begin, End) with the smallest counter
+// and a FORMAT_ID recorded in serialized sketches, since buckets are stored
+// as raw bytes and only load into the layout that wrote them. PADDED_SLOTS
+// selects the cache-line padded auxiliary list (see auxiliary::SlotCodec).
+// COLOCATED layouts instead provide Block<CellNumH, CellNumL, LeftPartWords>,
+// a bucket that carries its heavy cells' left parts in left_parts[], and the
+// sketch keeps no separate auxiliary list.
+
+// Interleaved {fp, counter} cells, as in the original implementation
+struct AoSLayout {
+    static constexpr uint32_t FORMAT_ID = 0;
+    static constexpr bool PADDED_SLOTS = false;
+    static constexpr bool COLOCATED = false;
+
+    template<uint32_t CellNumH, uint32_t CellNumL>
+    struct Bucket {
+        static_assert(CellNumH <= 64 && CellNumL <= 64, "at most 64 cells per part");
+
+        struct Cell {
+            uint16_t fp{0};    // Fingerprint
+            uint32_t c{0};     // Counter
+        };
+
+        static constexpr uint32_t FP_BITS = 16;
+
+        Cell cells[CellNumH + CellNumL];
+
+        uint16_t fp(uint32_t i) const { return cells[i].fp; }
+        uint32_t count(uint32_t i) const { return cells[i].c; }
+        void set_fp(uint32_t i, uint16_t fp) { cells[i].fp = fp; }
+        void set_count(uint32_t i, uint32_t c) { cells[i].c = c; }
+        void set(uint32_t i, uint16_t fp, uint32_t c) { cells[i].fp = fp; cells[i].c = c; }
+
+        template<uint32_t Begin, uint32_t End>
+        uint32_t find(uint16_t fp) const {
+            for (uint32_t i = Begin; i < End; i++) {
+                if (cells[i].c == 0 || cells[i].fp == fp) {
+                    return i;
+                }
+            }
+            return End;
+        }
+
+        template<uint32_t Begin, uint32_t End>
+        uint64_t match(uint16_t fp) const {
+            uint64_t mask = 0;
+            for (uint32_t i = Begin; i < End; i++) {
+                mask |= static_cast<uint64_t>(cells[i].fp == fp) << (i - Begin);
+            }
+            return mask;
+        }
+
+        template<uint32_t Begin, uint32_t End>
+        uint32_t smallest() const {
+            uint32_t smallest_idx = Begin;
+            for (uint32_t i = Begin + 1; i < End; i++) {
+                if (cells[i].c < cells[smallest_idx].c) {
+                    smallest_idx = i;
+                }
+            }
+            return smallest_idx;
+        }
+    };
+};
+
+// Fingerprint and counter lanes shared by the SoA-style layouts
+template<uint32_t CellNumH, uint32_t CellNumL>
+struct SoACells {
+    static_assert(CellNumH <= 64 && CellNumL <= 64, "at most 64 cells per part");
+
+    static constexpr uint32_t FP_BITS = 16;
+
+    uint16_t fps[CellNumH + CellNumL]{};
+    uint32_t counters[CellNumH + CellNumL]{};
+
+    uint16_t fp(uint32_t i) const { return fps[i]; }
+    uint32_t count(uint32_t i) const { return counters[i]; }
+    void set_fp(uint32_t i, uint16_t fp) { fps[i] = fp; }
+    void set_count(uint32_t i, uint32_t c) { counters[i] = c; }
+    void set(uint32_t i, uint16_t fp, uint32_t c) { fps[i] = fp; counters[i] = c; }
+
+    template<uint32_t Begin, uint32_t End>
+    uint32_t find(uint16_t fp) const {
+        uint64_t mask = match<Begin, End>(fp) |
+                        simd::match_epi32<End - Begin>(counters + Begin, 0);
+        if (!mask) {
+            return End;
+        }
+        uint32_t idx = static_cast<uint32_t>(__builtin_ctzll(mask));
+        if (idx >= End - Begin) __builtin_unreachable();  // masks only carry lane bits
+        return Begin + idx;
+    }
+
+    template<uint32_t Begin, uint32_t End>
+    uint64_t match(uint16_t fp) const {
+        return simd::match_epi16<End - Begin>(fps + Begin, fp);
+    }
+
+    template<uint32_t Begin, uint32_t End>
+    uint32_t smallest() const {
+        return Begin + simd::min_index_epu32<End - Begin>(counters + Begin);
+    }
+};
+
+// Fingerprints and counters in separate lanes, so each probe is one vector
+// compare (or min-reduction) per lane instead of a per-cell scalar loop
+struct SoALayout {
+    static constexpr uint32_t FORMAT_ID = 1;
+    static constexpr bool PADDED_SLOTS = false;
+    static constexpr bool COLOCATED = false;
+
+    template<uint32_t CellNumH, uint32_t CellNumL>
+    struct alignas(64) Bucket : SoACells<CellNumH, CellNumL> {};
+};
+
+// SoA buckets with the auxiliary list padded so no left part straddles a
+// cache line, for a few percent more auxiliary memory
+struct PaddedSoALayout : SoALayout {
+    static constexpr uint32_t FORMAT_ID = 2;
+    static constexpr bool PADDED_SLOTS = true;
+};
+
+// SoA buckets with each bucket's left parts stored right behind its
+// counters, so a heavy-cell update stays within one contiguous,
+// line-aligned block rather than also missing in a separate auxiliary list
+struct ColocatedLayout : SoALayout {
+    static constexpr uint32_t FORMAT_ID = 3;
+    static constexpr bool COLOCATED = true;
+
+    template<uint32_t CellNumH, uint32_t CellNumL, uint32_t LeftPartWords>
+    struct alignas(64) Block : SoACells<CellNumH, CellNumL> {
+        uint64_t left_parts[LeftPartWords]{};
+    };
+};
+
+// Cells bit-packed at FpBits + CounterBits each (16 + 18 = 34 bits by
+// default, as in the paper) instead of 8-byte {fp, counter} structs, so
+// about twice the buckets fit in the same cache. Counters saturate at
+// 2^CounterBits - 1, and fingerprints keep their low FpBits; keys that carry
+// bits in the fingerprint (KeyMixer splits) then no longer decode exactly.
+// Probes are scalar loops as in AoSLayout, fully unrolled so every cell's
+// bit offset is a constant.
+template<uint32_t CounterBits = 18, uint32_t FpBits = 16>
+struct PackedLayout {
+    static_assert(CounterBits >= 10 && CounterBits <= 32, "counters must reach the 512-packet left part check");
+    static_assert(FpBits >= 1 && FpBits <= 16, "fingerprints are at most 16 bits");
+
+    static constexpr uint32_t FORMAT_ID = 4 | (CounterBits << 8) | (FpBits << 16);
+    static constexpr bool PADDED_SLOTS = false;
+    static constexpr bool COLOCATED = false;
+
+    template<uint32_t CellNumH, uint32_t CellNumL>
+    struct Bucket {
+        static_assert(CellNumH <= 64 && CellNumL <= 64, "at most 64 cells per part");
+
+        static constexpr uint32_t FP_BITS = FpBits;
+        static constexpr uint32_t CELL_BITS = FpBits + CounterBits;
+        static constexpr uint32_t COUNT_MAX = uint32_t((uint64_t(1) << CounterBits) - 1);
+
+        uint64_t words[(CELL_BITS * (CellNumH + CellNumL) + 63) / 64]{};
+
+        uint16_t fp(uint32_t i) const { return static_cast<uint16_t>(load(i) & FP_MASK); }
+        uint32_t count(uint32_t i) const { return static_cast<uint32_t>(load(i) >> FpBits); }
+        void set_fp(uint32_t i, uint16_t fp) { store(i, (load(i) & ~FP_MASK) | (fp & FP_MASK)); }
+        void set_count(uint32_t i, uint32_t c) { store(i, (uint64_t(std::min(c, COUNT_MAX)) << FpBits) | (load(i) & FP_MASK)); }
+        void set(uint32_t i, uint16_t fp, uint32_t c) { store(i, (uint64_t(std::min(c, COUNT_MAX)) << FpBits) | (fp & FP_MASK)); }
+
+        template<uint32_t Begin, uint32_t End>
+        uint32_t find(uint16_t fp) const {
+#pragma GCC unroll 64
+            for (uint32_t i = Begin; i < End; i++) {
+                const uint64_t cell = load(i);
+                if ((cell >> FpBits) == 0 || (cell & FP_MASK) == (fp & FP_MASK)) {
+                    return i;
+                }
+            }
+            return End;
+        }
+
+        template<uint32_t Begin, uint32_t End>
+        uint64_t match(uint16_t fp) const {
+            uint64_t mask = 0;
+#pragma GCC unroll 64
+            for (uint32_t i = Begin; i < End; i++) {
+                mask |= static_cast<uint64_t>((load(i) & FP_MASK) == (fp & FP_MASK)) << (i - Begin);
+            }
+            return mask;
+        }
+
+        template<uint32_t Begin, uint32_t End>
+        uint32_t smallest() const {
+            uint32_t smallest_idx = Begin;
+            uint32_t smallest_count = count(Begin);
+#pragma GCC unroll 64
+            for (uint32_t i = Begin + 1; i < End; i++) {
+                if (count(i) < smallest_count) {
+                    smallest_idx = i;
+                    smallest_count = count(i);
+                }
+            }
+            return smallest_idx;
+        }
+
+    private:
+        static constexpr uint64_t FP_MASK = (uint64_t(1) << FpBits) - 1;
+        static constexpr uint64_t CELL_MASK = (uint64_t(1) << CELL_BITS) - 1;
+
+        // A cell spans at most two words
+        uint64_t load(uint32_t i) const {
+            const uint32_t bit = i * CELL_BITS;
+            const uint32_t offset = bit % 64;
+            uint64_t value = words[bit / 64] >> offset;
+            if (offset + CELL_BITS > 64) {
+                value |= words[bit / 64 + 1] << (64 - offset);
+            }
+            return value & CELL_MASK;
+        }
+
+        void store(uint32_t i, uint64_t value) {
+            const uint32_t bit = i * CELL_BITS;
+            const uint32_t offset = bit % 64;
+            uint64_t& low = words[bit / 64];
+            low = (low & ~(CELL_MASK << offset)) | (value << offset);
+            if (offset + CELL_BITS > 64) {
+                uint64_t& high = words[bit / 64 + 1];
+                high = (high & ~(CELL_MASK >> (64 - offset))) | (value >> (64 - offset));
+            }
+        }
+    };
+};
+
+// Bucket type a layout stores for the given shape
+template<typename Layout, uint32_t CellNumH, uint32_t CellNumL, uint32_t LeftPartWords,
+         bool Colocated = Layout::COLOCATED>
+struct LayoutBucket {
+    using type = typename Layout::template Bucket<CellNumH, CellNumL>;
+};
+
+template<typename Layout, uint32_t CellNumH, uint32_t CellNumL, uint32_t LeftPartWords>
+struct LayoutBucket<Layout, CellNumH, CellNumL, LeftPartWords, true> {
+    using type = typename Layout::template Block<CellNumH, CellNumL, LeftPartWords>;
+};
+
+} // namespace jigsaw
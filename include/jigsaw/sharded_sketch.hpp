@@ -0,0 +1,111 @@
+#pragma once
+#include "sketch.hpp"
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+#include <xxhash.h>
+
+namespace jigsaw {
+
+// One Sketch per worker thread. Keys are partitioned by the high bits of
+// their hash, so every key lives in exactly one shard and workers fed by
+// RSS-style queues (or a dispatcher using shard_of) never share state.
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout>
+class ShardedSketch {
+public:
+    using SketchType = Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout>;
+    using FlowInfo = typename SketchType::FlowInfo;
+
+    explicit ShardedSketch(size_t shard_num) {
+        if (shard_num == 0) {
+            throw std::invalid_argument("ShardedSketch needs at least one shard");
+        }
+        shards_.reserve(shard_num);
+        for (size_t i = 0; i < shard_num; i++) {
+            shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    size_t shard_num() const { return shards_.size(); }
+
+    // Shard owning a key: multiply-shift reduction of the top 32 hash bits.
+    // Independent of the bucket hash, so each shard uses all its buckets.
+    size_t shard_of(const KeyType& key) const {
+        uint64_t hash = XXH3_64bits(&key, KeyType::SIZE);
+        return static_cast<size_t>(((hash >> 32) * shards_.size()) >> 32);
+    }
+
+    // Worker path: all keys must belong to the given shard (checked in debug
+    // builds). The shard lock is taken once per batch and is uncontended
+    // except while a heavy-flow dump copies that same shard.
+    void insert_batch(size_t shard, const KeyType* keys, size_t n) {
+#ifndef NDEBUG
+        for (size_t i = 0; i < n; i++) {
+            assert(shard_of(keys[i]) == shard && "key inserted into another key's shard");
+        }
+#endif
+        std::lock_guard<std::mutex> lock(shards_[shard]->mutex);
+        shards_[shard]->sketch.insert_batch(keys, n);
+    }
+
+    void insert(const KeyType& key) {
+        insert_batch(shard_of(key), &key, 1);
+    }
+
+    uint32_t query(const KeyType& key) const {
+        Shard& shard = *shards_[shard_of(key)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.sketch.query(key);
+    }
+
+    // Heavy flows of all shards, largest first. Each shard is locked only
+    // for a raw copy of its buckets; decoding and sorting happen outside the
+    // lock, so ingestion pauses for a memcpy per shard.
+    std::vector<FlowInfo> get_heavy_flows(size_t limit = SIZE_MAX) const {
+        std::vector<std::vector<FlowInfo>> per_shard(shards_.size());
+        size_t total = 0;
+        for (size_t i = 0; i < shards_.size(); i++) {
+            std::unique_lock<std::mutex> lock(shards_[i]->mutex);
+            const typename SketchType::Snapshot snapshot = shards_[i]->sketch.snapshot();
+            lock.unlock();
+            per_shard[i] = snapshot.get_heavy_flows();
+            total += per_shard[i].size();
+        }
+
+        // k-way merge of the per-shard lists, which are already sorted
+        using Cursor = std::pair<uint32_t, size_t>;  // (count, shard)
+        std::priority_queue<Cursor> heads;
+        std::vector<size_t> positions(shards_.size(), 0);
+        for (size_t i = 0; i < per_shard.size(); i++) {
+            if (!per_shard[i].empty()) {
+                heads.emplace(per_shard[i][0].count, i);
+            }
+        }
+
+        std::vector<FlowInfo> flows;
+        flows.reserve(std::min(total, limit));
+        while (!heads.empty() && flows.size() < limit) {
+            size_t shard = heads.top().second;
+            heads.pop();
+            flows.push_back(per_shard[shard][positions[shard]]);
+            if (++positions[shard] < per_shard[shard].size()) {
+                heads.emplace(per_shard[shard][positions[shard]].count, shard);
+            }
+        }
+        return flows;
+    }
+
+private:
+    struct alignas(64) Shard {
+        SketchType sketch;
+        mutable std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+} // namespace jigsaw
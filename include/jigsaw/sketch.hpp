@@ -4,9 +4,25 @@
 #include <random>
 #include <chrono>
 #include "config.hpp"
+#include "layout.hpp"
+#include "utils/auxiliary_list.hpp"
+#include "utils/fast_range.hpp"
+#include "utils/key_mixer.hpp"
+#include "utils/mapped_file.hpp"
+#include "utils/random.hpp"
+#include "utils/stats.hpp"
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <fstream>
 #include <functional>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <xxhash.h>  
 
 namespace jigsaw {
@@ -39,6 +55,7 @@ struct GenericKey {
 struct CompactStringKey {
     static constexpr uint8_t BITS_PER_CHAR = 5;
     static constexpr uint8_t MAX_LENGTH = 12;  // 12 * 5 = 60 bits
+    static constexpr size_t SIZE = 9;          // data + length
 
     uint64_t data{0};    // Compressed string data
     uint8_t length{0};   // String length
@@ -77,15 +94,122 @@ private:
     }
 };
 
+// 64-symbol alphabet for StringKey<Capacity, 6>: lowercase letters, digits
+// and the punctuation of URLs, hostnames and log lines. Uppercase letters
+// fold to lowercase; every other byte shares code OTHER and decodes as
+// OTHER_CHAR.
+struct SixBitAlphabet {
+    static constexpr char SYMBOLS[] = "abcdefghijklmnopqrstuvwxyz0123456789.-_/:?=&%+@~!$'()*,;[]# <>|";
+    static constexpr uint8_t OTHER = 63;
+    static constexpr char OTHER_CHAR = '\x7f';
+    static_assert(sizeof(SYMBOLS) - 1 == OTHER, "one code is left for other bytes");
+
+    static uint8_t encode(char c) { return CODES[static_cast<uint8_t>(c)]; }
+    static char decode(uint8_t code) { return code < OTHER ? SYMBOLS[code] : OTHER_CHAR; }
+
+private:
+    static constexpr std::array<uint8_t, 256> CODES = [] {
+        std::array<uint8_t, 256> codes{};
+        for (auto& code : codes) {
+            code = OTHER;
+        }
+        for (uint8_t i = 0; i < OTHER; i++) {
+            codes[static_cast<uint8_t>(SYMBOLS[i])] = i;
+        }
+        for (char c = 'A'; c <= 'Z'; c++) {
+            codes[static_cast<uint8_t>(c)] = codes[static_cast<uint8_t>(c | 0x20)];
+        }
+        return codes;
+    }();
+};
+
+// Strings of up to Capacity characters, for identifiers CompactStringKey
+// cannot tell apart (URLs, hostnames, log templates). With CharBits = 8
+// bytes are kept as they are; CharBits = 6 packs 4 characters into 3 bytes
+// over SixBitAlphabet. A longer string keeps its first Capacity characters
+// and its length (saturating at 255), so it does not collide with its own
+// prefix; for long strings that must be told apart in full see
+// InternedStringSketch. Unused characters are zero, so equal strings have
+// equal bytes and the whole key splits reversibly through MixedKeyHasher.
+template<size_t Capacity, uint32_t CharBits = 8>
+struct StringKey {
+    static_assert(CharBits == 8 || CharBits == 6, "byte or 6-bit characters");
+    static_assert(CharBits == 8 || Capacity % 4 == 0, "6-bit keys pack 4 characters per 3 bytes");
+    static_assert(Capacity > 0 && Capacity <= 255, "lengths are stored in one byte");
+
+    static constexpr size_t CAPACITY = Capacity;
+    static constexpr size_t DATA_BYTES = Capacity * CharBits / 8;
+    static constexpr size_t SIZE = DATA_BYTES + 1;  // data + length
+
+    uint8_t data[DATA_BYTES]{};
+    uint8_t length{0};  // Original length, up to 255
+
+    StringKey() = default;
+
+    explicit StringKey(std::string_view sv) {
+        length = static_cast<uint8_t>(std::min(sv.length(), size_t(255)));
+        const size_t n = std::min(sv.length(), Capacity);
+        if constexpr (CharBits == 8) {
+            std::memcpy(data, sv.data(), n);
+        } else {
+            for (size_t group = 0; group * 4 < n; group++) {
+                uint32_t packed = 0;
+                for (size_t i = 0; i < 4 && group * 4 + i < n; i++) {
+                    packed |= uint32_t(SixBitAlphabet::encode(sv[group * 4 + i])) << (6 * i);
+                }
+                data[3 * group] = static_cast<uint8_t>(packed);
+                data[3 * group + 1] = static_cast<uint8_t>(packed >> 8);
+                data[3 * group + 2] = static_cast<uint8_t>(packed >> 16);
+            }
+        }
+    }
+
+    // Characters stored, at most Capacity
+    size_t size() const { return std::min(size_t(length), Capacity); }
+
+    std::string to_string() const {
+        if constexpr (CharBits == 8) {
+            return std::string(reinterpret_cast<const char*>(data), size());
+        } else {
+            std::string result(size(), '\0');
+            for (size_t i = 0; i < result.size(); i++) {
+                const size_t group = i / 4;
+                const uint32_t packed = data[3 * group] | (uint32_t(data[3 * group + 1]) << 8) |
+                                        (uint32_t(data[3 * group + 2]) << 16);
+                result[i] = SixBitAlphabet::decode((packed >> (6 * (i % 4))) & 0x3F);
+            }
+            return result;
+        }
+    }
+};
+
+// divide_key splits a key into its bucket index, fingerprint and left part;
+// hash() produces the same fingerprint and left part plus the value that is
+// reduced onto the buckets (reduce_range), for sketches sized at runtime.
+// combine_key inverts the split; it recovers the exact key only from a
+// sketch that stores at least LEFT_PART_BITS of left part, and left parts
+// are passed as LEFT_PART_WORDS words.
 template<typename KeyType, uint32_t BucketNum>
 struct KeyHasher {
+    static constexpr uint32_t LEFT_PART_BITS = 0;
+    static constexpr uint32_t LEFT_PART_WORDS = 0;
+
+    static uint32_t hash(const KeyType& key, uint16_t& fp, uint64_t* left_part);
     static void divide_key(const KeyType& key, uint32_t& index, uint16_t& fp, uint64_t* left_part);
     static void combine_key(KeyType& key, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part);
 };
 
 template<uint32_t BucketNum>
 struct KeyHasher<IPv4Flow, BucketNum> {
+    // Two 52-bit products, one per word
+    static constexpr uint32_t LEFT_PART_BITS = 64 + 52;
+    static constexpr uint32_t LEFT_PART_WORDS = 2;
+
     static void divide_key(const IPv4Flow& key, uint32_t& index, uint16_t& fp, uint64_t* left_part) {
+        index = reduce_range<BucketNum>(hash(key, fp, left_part));
+    }
+
+    static uint32_t hash(const IPv4Flow& key, uint16_t& fp, uint64_t* left_part) {
         const uint64_t* key64 = reinterpret_cast<const uint64_t*>(&key);
         left_part[0] = key64[0];
         left_part[1] = key64[1];
@@ -102,11 +226,11 @@ struct KeyHasher<IPv4Flow, BucketNum> {
         temp ^= (uint32_t)(temp_parts[1] & Config::MASK_26BITS);
         temp ^= (uint32_t)(temp_parts[1] >> 26);
 
-        index = temp % BucketNum;
         fp = static_cast<uint16_t>(temp >> 13);
         
         left_part[0] = temp_parts[0];
         left_part[1] = temp_parts[1];
+        return temp;
     }
 
     static void combine_key(IPv4Flow& key, uint32_t /*bucket_idx*/, uint16_t /*fp*/, const uint64_t* left_part) {
@@ -122,400 +246,562 @@ struct KeyHasher<IPv4Flow, BucketNum> {
     }
 };
 
-struct SpeckCipher {
-    static constexpr uint64_t ROUNDS = 34;
-    static constexpr uint64_t KEY[2] = { 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL };
+// Keys of any size, split reversibly through KeyMixer. With a power-of-two
+// bucket count the bucket index carries log2(BucketNum) of the key's bits;
+// the fingerprint carries 16 and the left part the rest, so keys decode
+// exactly when the sketch keeps LEFT_PART_BITS of left part.
+template<typename KeyType, uint32_t BucketNum>
+struct MixedKeyHasher {
+    static constexpr uint32_t INDEX_BITS = (BucketNum & (BucketNum - 1)) == 0 ? __builtin_ctz(BucketNum) : 0;
+    using Split = MixedKeySplit<KeyType::SIZE, INDEX_BITS>;
+    static constexpr uint32_t LEFT_PART_BITS = Split::LEFT_PART_BITS;
+    static constexpr uint32_t LEFT_PART_WORDS = Split::LEFT_PART_WORDS;
+
+    static void divide_key(const KeyType& key, uint32_t& index, uint16_t& fp, uint64_t* left_part) {
+        index = reduce_range<BucketNum>(hash(key, fp, left_part));
+    }
 
-    static uint64_t rotate(uint64_t x, int k) {
-        return (x >> k) | (x << (64 - k));
+    static uint32_t hash(const KeyType& key, uint16_t& fp, uint64_t* left_part) {
+        return Split::split(reinterpret_cast<const uint8_t*>(&key), fp, left_part);
     }
 
-    static void decrypt_block(uint64_t& left, uint64_t& right) {
-        for (size_t i = 0; i < ROUNDS; ++i) {
-            right ^= left;
-            right = rotate(right, -3);
-            left ^= KEY[0];
-            left -= right;
-            left = rotate(left, -8);
-        }
+    static void combine_key(KeyType& key, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+        Split::join(reinterpret_cast<uint8_t*>(&key), bucket_idx, fp, left_part);
     }
 };
 
+// The 5-tuple's 37 bytes are contiguous at the start of the struct
 template<uint32_t BucketNum>
-struct KeyHasher<IPv6Flow, BucketNum> {
-    static void divide_key(const IPv6Flow& key, uint32_t& index, uint16_t& fp, uint64_t* left_part) {
-        // We now have direct access to 64-bit words
-        // Process source IP (2 words)
-        uint64_t h1 = (key.src_ip[0] & Config::MI_MASK) * Config::MI_A;
-        uint64_t h2 = (key.src_ip[1] & Config::MI_MASK) * Config::MI_A;
-        
-        // Process destination IP (2 words)
-        uint64_t h3 = (key.dst_ip[0] & Config::MI_MASK) * Config::MI_A;
-        uint64_t h4 = (key.dst_ip[1] & Config::MI_MASK) * Config::MI_A;
-        
-        // Process ports and protocol (pack into a single 64-bit word)
-        uint64_t h5 = (static_cast<uint64_t>(key.src_port) << 24) |
-                     (static_cast<uint64_t>(key.dst_port) << 8) |
-                     key.protocol;
-        h5 = (h5 & Config::MI_MASK) * Config::MI_A;
-        
-        // Combine hashes while preserving reversibility
-        uint32_t temp = (uint32_t)(h1 & Config::MASK_26BITS);
-        temp ^= (uint32_t)(h2 >> 13);
-        temp ^= (uint32_t)(h3 & Config::MASK_26BITS);
-        temp ^= (uint32_t)(h4 >> 13);
-        temp ^= (uint32_t)(h5 & Config::MASK_26BITS);
-
-        index = temp % BucketNum;
-        fp = static_cast<uint16_t>(temp);
-        
-        // Store transformed parts for reconstruction
-        // Pack h1-h4 into left_part array efficiently
-        left_part[0] = (h1 & Config::MI_MASK) | (h2 << 52);
-        left_part[1] = (h3 & Config::MI_MASK) | (h4 << 52);
-        // Note: h5 (ports+protocol) can be reconstructed from the fingerprint
-    }
-
-    static void combine_key(IPv6Flow& key, uint32_t /*bucket_idx*/, uint16_t fp, const uint64_t* left_part) {
-        // Reconstruct the 64-bit words
-        uint64_t h1 = (left_part[0] & Config::MI_MASK) * Config::MI_A_INV;
-        uint64_t h2 = (left_part[0] >> 52) * Config::MI_A_INV;
-        uint64_t h3 = (left_part[1] & Config::MI_MASK) * Config::MI_A_INV;
-        uint64_t h4 = (left_part[1] >> 52) * Config::MI_A_INV;
-        
-        // Reconstruct source and destination IPs
-        key.src_ip[0] = h1;
-        key.src_ip[1] = h2;
-        key.dst_ip[0] = h3;
-        key.dst_ip[1] = h4;
-        
-        // Reconstruct ports and protocol from fingerprint
-        // Note: This is a simplified reconstruction as we don't store h5 directly
-        // In practice, the actual values will be preserved due to the hash properties
-        key.src_port = static_cast<uint16_t>(fp >> 16);
-        key.dst_port = static_cast<uint16_t>((fp >> 8) & 0xFF);
-        key.protocol = static_cast<uint8_t>(fp & 0xFF);
+struct KeyHasher<IPv6Flow, BucketNum> : MixedKeyHasher<IPv6Flow, BucketNum> {};
+
+template<size_t N, uint32_t BucketNum>
+struct KeyHasher<GenericKey<N>, BucketNum> : MixedKeyHasher<GenericKey<N>, BucketNum> {};
+
+template<size_t Capacity, uint32_t CharBits, uint32_t BucketNum>
+struct KeyHasher<StringKey<Capacity, CharBits>, BucketNum> : MixedKeyHasher<StringKey<Capacity, CharBits>, BucketNum> {};
+
+// data and length are the first SIZE bytes of the struct
+template<uint32_t BucketNum>
+struct KeyHasher<CompactStringKey, BucketNum> : MixedKeyHasher<CompactStringKey, BucketNum> {};
+
+// On-disk/wire header of a serialized Sketch. The buckets and the auxiliary
+// list follow as raw native-endian bytes, each starting on a 64-byte
+// boundary so a mapped file can be used in place.
+struct SketchFileHeader {
+    static constexpr char MAGIC[8] = {'J', 'I', 'G', 'S', 'A', 'W', 'S', 'K'};
+    static constexpr uint32_t VERSION = 3;   // 2: auxiliary list gained a slack word, 3: string keys mix
+    static constexpr uint32_t ENDIAN_MARK = 0x01020304;
+    static constexpr uint64_t ALIGNMENT = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;      // ENDIAN_MARK as written by the producer
+    uint32_t key_size;
+    uint32_t bucket_num;
+    uint32_t left_part_bits;
+    uint32_t cell_num_h;
+    uint32_t cell_num_l;
+    uint32_t layout_id;       // Layout::FORMAT_ID
+    uint32_t bucket_size;     // sizeof(Bucket)
+    uint32_t reserved;
+    uint64_t buckets_offset;
+    uint64_t auxiliary_offset;
+    uint64_t auxiliary_word_num;
+    uint64_t file_size;
+
+    static constexpr uint64_t align(uint64_t offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
     }
 };
 
-template<size_t N, uint32_t BucketNum>
-struct KeyHasher<GenericKey<N>, BucketNum> {
-    static void divide_key(const GenericKey<N>& key, uint32_t& index, uint16_t& fp, uint64_t* left_part) {
-        // Use the fast_reversible_hash implementation for generic keys
-        fast_reversible_hash(key.data, N, index, fp, left_part);
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout, typename Rng = WyRand>
+class Sketch {
+private:
+    using Codec = auxiliary::SlotCodec<LeftPartBits, Layout::PADDED_SLOTS>;
+    using Hasher = KeyHasher<KeyType, BucketNum>;
+
+    // Colocated layouts keep each bucket's slots in the bucket itself
+    using Bucket = typename LayoutBucket<Layout, CellNumH, CellNumL, Codec::word_num(CellNumH)>::type;
+
+    static constexpr uint64_t AUXILIARY_WORD_NUM =
+        Layout::COLOCATED ? 0 : Codec::word_num(uint64_t(BucketNum) * CellNumH);
+
+    Bucket buckets_[BucketNum];
+    uint64_t* auxiliary_list_;
+    Rng rng_;
+    StatsRecorder<> stats_;  // empty unless JIGSAW_ENABLE_STATS
+
+
+    uint8_t get_left_part(uint32_t slot_idx, uint64_t* left_part) const {
+        return get_left_part(buckets_, auxiliary_list_, slot_idx, left_part);
     }
 
-    static void combine_key(GenericKey<N>& key, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
-        uint64_t blocks[4] = {bucket_idx, fp, left_part[0], left_part[1]};
-        for (int i = 0; i < 4; i += 2) {
-            SpeckCipher::decrypt_block(blocks[i], blocks[i+1]);
+    // Static so a mapped View can decode its auxiliary list in place
+    static uint8_t get_left_part(const Bucket* buckets, const uint64_t* auxiliary_list,
+                                 uint32_t slot_idx, uint64_t* left_part) {
+        if constexpr (Layout::COLOCATED) {
+            return Codec::get_left_part(buckets[slot_idx / CellNumH].left_parts, slot_idx % CellNumH, left_part);
+        } else {
+            return Codec::get_left_part(auxiliary_list, slot_idx, left_part);
         }
-        memcpy(key.data, blocks, N);
     }
-};
 
-template<uint32_t BucketNum>
-struct KeyHasher<CompactStringKey, BucketNum> {
-    static void divide_key(const CompactStringKey& key, uint32_t& index, uint16_t& fp, uint64_t* left_part) {
-        // Store the compressed data directly
-        left_part[0] = key.data;
-        left_part[1] = key.length;
-
-        // Use the data for hashing
-        uint32_t temp = static_cast<uint32_t>(key.data & Config::MASK_26BITS);
-        temp ^= static_cast<uint32_t>(key.data >> 26);
-        temp ^= static_cast<uint32_t>(key.length);
-
-        index = temp % BucketNum;
-        fp = static_cast<uint16_t>(temp >> 13);
+    void set_left_part(uint32_t slot_idx, const uint64_t* left_part) {
+        if constexpr (Layout::COLOCATED) {
+            Codec::set_left_part(buckets_[slot_idx / CellNumH].left_parts, slot_idx % CellNumH, left_part);
+        } else {
+            Codec::set_left_part(auxiliary_list_, slot_idx, left_part);
+        }
     }
 
-    static void combine_key(CompactStringKey& key, uint32_t /*bucket_idx*/, uint16_t /*fp*/, const uint64_t* left_part) {
-        // Reconstruct the string data
-        key.data = left_part[0];
-        key.length = static_cast<uint8_t>(left_part[1]);
+    void set_left_part_counter(uint32_t slot_idx, uint8_t counter) {
+        if constexpr (Layout::COLOCATED) {
+            Codec::set_extra_counter(buckets_[slot_idx / CellNumH].left_parts, slot_idx % CellNumH, counter);
+        } else {
+            Codec::set_extra_counter(auxiliary_list_, slot_idx, counter);
+        }
     }
-};
 
-template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL>
-class Sketch {
-private:
-    // Cell structure matching the original
-    struct Cell {
-        uint16_t fp{0};    // Fingerprint
-        uint32_t c{0};     // Counter
+public:
+    // Words of a left part as divide_key produces it
+    static constexpr uint32_t LEFT_PART_WORDS = std::max(Codec::LEFT_PART_WORDS, Hasher::LEFT_PART_WORDS);
+
+    // Whether get_heavy_flows and top_k return exact keys; with fewer left
+    // part bits (or fingerprint bits, see PackedLayout) keys still count
+    // correctly but decode lossily
+    static constexpr bool EXACT_KEYS = LeftPartBits >= Hasher::LEFT_PART_BITS && Bucket::FP_BITS == 16;
+
+    struct FlowInfo {
+        KeyType key;
+        uint32_t count;
+        
+        bool operator<(const FlowInfo& other) const {
+            return count > other.count;
+        }
     };
 
-    Cell buckets_[BucketNum][CellNumH + CellNumL];
-    uint64_t* auxiliary_list_;
-    std::mt19937 rng_;  
+    std::vector<FlowInfo> get_heavy_flows() const {
+        return collect_heavy_flows(buckets_, auxiliary_list_, [](uint32_t, uint32_t count) { return count; });
+    }
+
+    // Append the heavy flows of one bucket to flows, unsorted
+    void bucket_heavy_flows(uint32_t bucket_idx, std::vector<FlowInfo>& flows) const {
+        const auto& bucket = buckets_[bucket_idx];
+        for (uint32_t i = 0; i < CellNumH; i++) {
+            if (bucket.count(i) > 0) {
+                FlowInfo flow;
+                uint64_t left_part[LEFT_PART_WORDS] = {0};
+                get_left_part(bucket_idx * CellNumH + i, left_part);
+                KeyHasher<KeyType, BucketNum>::combine_key(flow.key, bucket_idx, bucket.fp(i), left_part);
+                flow.count = bucket.count(i);
+                flows.push_back(flow);
+            }
+        }
+    }
+
+    // The k heaviest flows, largest first. Only counters are scanned; keys
+    // are decoded for the k winners alone.
+    std::vector<FlowInfo> top_k(size_t k) const {
+        return collect_top_k(buckets_, auxiliary_list_, k);
+    }
+
+    // Heavy flows with each count replaced by adjust(bucket_idx, count);
+    // flows adjusted to 0 are dropped. Lets wrappers that keep per-bucket
+    // state (windows, decay) report without touching the buckets.
+    template<typename Adjust>
+    std::vector<FlowInfo> get_heavy_flows(Adjust adjust) const {
+        return collect_heavy_flows(buckets_, auxiliary_list_, adjust);
+    }
+
+    Sketch() : Sketch(std::chrono::steady_clock::now().time_since_epoch().count()) {}
+
+    // Fixed seed for reproducible replacement decisions
+    explicit Sketch(uint64_t seed) : rng_(seed) {
+        auxiliary_list_ = new uint64_t[AUXILIARY_WORD_NUM]();
+    }
+
+    ~Sketch() {
+        delete[] auxiliary_list_;
+    }
 
-    static constexpr size_t COM_BYTES = 10;  
+    // Returns the key's heavy counter after the insert (0 if it is only
+    // tracked in a light cell), e.g. to maintain a running top-k
+    uint32_t insert(const KeyType& key) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[LEFT_PART_WORDS] = {0};
+        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+        return update(bucket_idx, fp, left_part, 1);
+    }
+
+    // Count the key weight times (e.g. a packet's bytes) in a single update:
+    // matches add weight, and a miss takes the smallest cell with
+    // probability weight / counter. weight must be at least 1. Counters
+    // saturate at the layout's maximum, which for PackedLayout<18> is 256 KiB
+    // of bytes; count bytes with 32-bit layouts.
+    uint32_t insert(const KeyType& key, uint32_t weight) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[LEFT_PART_WORDS] = {0};
+        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+        return update(bucket_idx, fp, left_part, weight);
+    }
 
-    static constexpr uint64_t SPECK_ROUNDS = 34;
-    static constexpr uint64_t SPECK_KEY[2] = { 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL };
+    // Hash the whole batch first and prefetch every target bucket and its
+    // auxiliary words, so the cache misses overlap instead of serializing
+    void insert_batch(const KeyType* keys, size_t n) {
+        for_each_hashed(keys, n, [this](size_t, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            update(bucket_idx, fp, left_part, 1);
+        });
+    }
 
-    static uint64_t SPECK_ROT(uint64_t x, int k) {
-        return (x >> k) | (x << (64 - k));
+    // insert_batch with a weight per key
+    void insert_batch(const KeyType* keys, const uint32_t* weights, size_t n) {
+        for_each_hashed(keys, n, [&](size_t i, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            update(bucket_idx, fp, left_part, weights[i]);
+        });
     }
 
-    static void SPECK_ROUND(uint64_t& x, uint64_t& y, uint64_t k) {
-        x = SPECK_ROT(x, 8);
-        x += y;
-        x ^= k;
-        y = SPECK_ROT(y, 3);
-        y ^= x;
+    uint32_t query(const KeyType& key) const {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[LEFT_PART_WORDS] = {0};
+        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+        return lookup(bucket_idx, fp, left_part);
     }
 
-    static void SPECK_INVERSE_ROUND(uint64_t& x, uint64_t& y, uint64_t k) {
-        y ^= x;
-        y = SPECK_ROT(y, -3);
-        x ^= k;
-        x -= y;
-        x = SPECK_ROT(x, -8);
+    // Pre-hashed interface: split a key once, then insert or look it up by
+    // bucket. Used by wrappers that keep per-bucket state.
+    static void divide_key(const KeyType& key, uint32_t& bucket_idx, uint16_t& fp, uint64_t* left_part) {
+        std::fill_n(left_part, LEFT_PART_WORDS, 0);
+        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
     }
 
-    // Encrypt a block using SPECK
-    static void encrypt_block(uint64_t& left, uint64_t& right) {
-        for (size_t i = 0; i < SPECK_ROUNDS; ++i) {
-            SPECK_ROUND(left, right, SPECK_KEY[0]);
+    // divide_key for n keys. Kept apart from the bucket prefetches so the
+    // loop vectorizes: the IPv4 split is shifts, subtracts and masks (MI_A
+    // is 2^31 - 1), which the compiler packs 8 keys per AVX-512 vector.
+    static void divide_keys(const KeyType* keys, size_t n, uint32_t* bucket_idx, uint16_t* fp,
+                            uint64_t (*left_part)[LEFT_PART_WORDS]) {
+        for (size_t i = 0; i < n; i++) {
+            divide_key(keys[i], bucket_idx[i], fp[i], left_part[i]);
         }
     }
 
-    // Decrypt a block using SPECK
-    static void decrypt_block(uint64_t& left, uint64_t& right) {
-        for (size_t i = 0; i < SPECK_ROUNDS; ++i) {
-            SPECK_INVERSE_ROUND(left, right, SPECK_KEY[0]);
+    uint32_t insert_hashed(uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part, uint32_t weight = 1) {
+        return update(bucket_idx, fp, left_part, weight);
+    }
+
+    uint32_t query_hashed(uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) const {
+        return lookup(bucket_idx, fp, left_part);
+    }
+
+    void prefetch(uint32_t bucket_idx) const {
+        prefetch_bucket(bucket_idx);
+    }
+
+    // The batch loop: split keys MAX_BATCH at a time, prefetch the chunk's
+    // buckets, then call fn(i, bucket_idx, fp, left_part) for each keys[i]
+    // in order. Wrappers pass only their per-key action.
+    template<typename Fn>
+    void for_each_hashed(const KeyType* keys, size_t n, Fn&& fn) const {
+        for (size_t base = 0; base < n; base += MAX_BATCH) {
+            size_t batch = std::min(n - base, MAX_BATCH);
+            uint32_t bucket_idx[MAX_BATCH];
+            uint16_t fp[MAX_BATCH];
+            uint64_t left_part[MAX_BATCH][LEFT_PART_WORDS];
+
+            divide_keys(keys + base, batch, bucket_idx, fp, left_part);
+            for (size_t i = 0; i < batch; i++) {
+                prefetch_bucket(bucket_idx[i]);
+            }
+            for (size_t i = 0; i < batch; i++) {
+                fn(base + i, bucket_idx[i], fp[i], static_cast<const uint64_t*>(left_part[i]));
+            }
         }
     }
 
-private:
-    // Fast reversible hash for variable-length keys
-    static void fast_reversible_hash(const uint8_t* key, size_t len, 
-                                   uint32_t& index, uint16_t& fp, uint64_t* left_part) {
-        // Use 64-bit blocks for efficiency
-        uint64_t h1 = 0x736f6d6570736575ULL;
-        uint64_t h2 = 0x646f72616e646f6dULL;
-        
-        const uint64_t* blocks = reinterpret_cast<const uint64_t*>(key);
-        size_t nblocks = len / 8;
-        
-        // Process 8-byte blocks
-        for (size_t i = 0; i < nblocks; i++) {
-            uint64_t k = blocks[i];
-            
-            // Reversible mixing function
-            h1 = ((h1 << 13) | (h1 >> 51)) + k;
-            h2 = ((h2 << 29) | (h2 >> 35)) ^ k;
+    // Branch counts since construction or reset_stats(); all zero unless
+    // built with JIGSAW_ENABLE_STATS (see utils/stats.hpp)
+    SketchStats stats() const {
+        return stats_.snapshot();
+    }
+
+    void reset_stats() {
+        stats_.reset();
+    }
+
+    // Empty every cell. All-zero bytes are the empty state in every layout,
+    // so this is a streaming (non-temporal) fill.
+    void clear() {
+        static_assert(std::is_trivially_copyable_v<Bucket>);
+        simd::stream_zero(buckets_, sizeof(Bucket) * size_t(BucketNum));
+        simd::stream_zero(auxiliary_list_, AUXILIARY_WORD_NUM * sizeof(uint64_t));
+    }
+
+    // Empty one bucket's cells, including their left parts
+    void clear_bucket(uint32_t bucket_idx) {
+        buckets_[bucket_idx] = Bucket{};
+        if constexpr (!Layout::COLOCATED) {
+            for (uint32_t i = 0; i < CellNumH; i++) {
+                Codec::clear_slot(auxiliary_list_, uint64_t(bucket_idx) * CellNumH + i);
+            }
         }
-        
-        // Handle remaining bytes
-        const uint8_t* tail = key + nblocks * 8;
-        uint64_t k = 0;
-        for (size_t i = 0; i < (len & 7); i++) {
-            k = (k << 8) | tail[i];
+    }
+
+    // Halve one bucket's counters shift times; cells that reach 0 become
+    // free again
+    void decay_bucket(uint32_t bucket_idx, uint32_t shift) {
+        auto& bucket = buckets_[bucket_idx];
+        for (uint32_t i = 0; i < CellNumH + CellNumL; i++) {
+            bucket.set_count(i, shift >= 32 ? 0 : bucket.count(i) >> shift);
         }
-        
-        h1 = ((h1 << 13) | (h1 >> 51)) + k;
-        h2 = ((h2 << 29) | (h2 >> 35)) ^ k;
-        
-        // Generate outputs
-        index = h1 % BucketNum;
-        fp = static_cast<uint16_t>(h2);
-        left_part[0] = h1;
-        left_part[1] = h2;
-    }
-
-    // Fast reversible transformations optimized for different key sizes
-    template<size_t KeySize>
-    static void optimized_transform(const uint8_t* key, uint32_t& index, 
-                                  uint16_t& fp, uint64_t* left_part) {
-        if constexpr (KeySize <= 16) {  // IPv4 flows or similar small keys
-            // Similar to original 13-byte approach but generalized
-            const uint64_t* key64 = reinterpret_cast<const uint64_t*>(key);
-            uint64_t k1 = key64[0];
-            uint64_t k2 = key64[1];
-            
-            // Use Mersenne prime multiplication for reversibility
-            uint64_t h1 = (k1 & Config::MI_MASK) * Config::MI_A;
-            h1 &= Config::MI_MASK;
-            
-            uint64_t h2 = ((k2 << 12) | (k1 >> 52)) * Config::MI_A;
-            h2 &= Config::MI_MASK;
-            
-            // Generate index and fingerprint
-            uint32_t temp = (uint32_t)(h1 & Config::MASK_26BITS);
-            temp ^= (uint32_t)(h1 >> 26);
-            temp ^= (uint32_t)(h2 & Config::MASK_26BITS);
-            temp ^= (uint32_t)(h2 >> 26);
-            
-            index = temp % BucketNum;
-            fp = static_cast<uint16_t>(temp >> 13);
-            
-            // Store transformed parts for reconstruction
-            left_part[0] = h1;
-            left_part[1] = h2;
-        }
-        else if constexpr (KeySize == 37) {  // IPv6 flows specifically
-            const IPv6Flow& flow = *reinterpret_cast<const IPv6Flow*>(key);
-            
-            // Process source IP (2 words)
-            uint64_t h1 = (flow.src_ip[0] & Config::MI_MASK) * Config::MI_A;
-            uint64_t h2 = (flow.src_ip[1] & Config::MI_MASK) * Config::MI_A;
-            
-            // Process destination IP (2 words)
-            uint64_t h3 = (flow.dst_ip[0] & Config::MI_MASK) * Config::MI_A;
-            uint64_t h4 = (flow.dst_ip[1] & Config::MI_MASK) * Config::MI_A;
-            
-            // Process ports and protocol
-            uint64_t h5 = (static_cast<uint64_t>(flow.src_port) << 24) |
-                         (static_cast<uint64_t>(flow.dst_port) << 8) |
-                         flow.protocol;
-            h5 = (h5 & Config::MI_MASK) * Config::MI_A;
-            
-            // Combine hashes while preserving reversibility
-            uint32_t temp = (uint32_t)(h1 & Config::MASK_26BITS);
-            temp ^= (uint32_t)(h2 >> 13);
-            temp ^= (uint32_t)(h3 & Config::MASK_26BITS);
-            temp ^= (uint32_t)(h4 >> 13);
-            temp ^= (uint32_t)(h5 & Config::MASK_26BITS);
-            
-            index = temp % BucketNum;
-            fp = static_cast<uint16_t>(temp);
-            
-            // Store transformed parts
-            left_part[0] = (h1 & Config::MI_MASK) | (h2 << 52);
-            left_part[1] = (h3 & Config::MI_MASK) | (h4 << 52);
-        }
-        else {  // Fallback for other sizes
-            fast_reversible_hash(key, KeySize, index, fp, left_part);
-        }
-    }
-
-    void divide_key(const uint8_t* key, uint32_t& index, uint16_t& fp, uint64_t* left_part) {
-        optimized_transform<Config::KEY_SIZE>(key, index, fp, left_part);
     }
 
-    uint8_t get_left_part(uint32_t slot_idx, uint64_t* left_part) const {
-        uint8_t counter = 0;
-        const unsigned int slot_length = LeftPartBits + Config::EXTRA_BITS_NUM;
-        unsigned int bit_idx = slot_idx * slot_length;
-        unsigned int slot_word_idx = bit_idx / 64;
-        unsigned int slot_bit_idx_in_word = bit_idx % 64;
-
-        unsigned int extracted_bits_num = 0;
-        unsigned int lp_word_idx = 0;
-        unsigned int lp_bit_in_word = 0;
-
-        while (extracted_bits_num < slot_length) {
-            unsigned int to_extract_bits_num = std::min(slot_length - extracted_bits_num, 64u - lp_bit_in_word);
-            to_extract_bits_num = std::min(to_extract_bits_num, 64u - slot_bit_idx_in_word);
-
-            uint64_t extract_part;
-            if (to_extract_bits_num == 64) {
-                extract_part = auxiliary_list_[slot_word_idx];
-            } else {
-                uint64_t extract_part_mask = ((uint64_t)1 << to_extract_bits_num) - 1;
-                extract_part = (auxiliary_list_[slot_word_idx] >> slot_bit_idx_in_word) & extract_part_mask;
-            }
+    void query_batch(const KeyType* keys, size_t n, uint32_t* counts) const {
+        for_each_hashed(keys, n, [&](size_t i, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            counts[i] = lookup(bucket_idx, fp, left_part);
+        });
+    }
 
-            if (lp_bit_in_word == 0) {
-                left_part[lp_word_idx] = 0;
-            }
-            left_part[lp_word_idx] += extract_part << lp_bit_in_word;
+    // Bytes of counters and left parts actually allocated: the buckets with
+    // their padding plus the auxiliary list
+    static constexpr uint64_t MEMORY_SIZE =
+        sizeof(Bucket) * uint64_t(BucketNum) + AUXILIARY_WORD_NUM * sizeof(uint64_t);
+
+    // Serialized form: a SketchFileHeader, then the buckets and the auxiliary
+    // list as raw bytes. Loading requires the same template parameters and
+    // layout; the RNG state is not persisted.
+    static constexpr uint64_t SERIALIZED_SIZE =
+        SketchFileHeader::align(SketchFileHeader::align(sizeof(SketchFileHeader)) + sizeof(Bucket) * uint64_t(BucketNum)) +
+        AUXILIARY_WORD_NUM * sizeof(uint64_t);
+
+    void serialize(std::ostream& out) const {
+        const SketchFileHeader header = make_header();
+        static const char padding[SketchFileHeader::ALIGNMENT] = {};
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(padding, header.buckets_offset - sizeof(header));
+        out.write(reinterpret_cast<const char*>(buckets_), sizeof(Bucket) * uint64_t(BucketNum));
+        out.write(padding, header.auxiliary_offset - header.buckets_offset - sizeof(Bucket) * uint64_t(BucketNum));
+        out.write(reinterpret_cast<const char*>(auxiliary_list_), AUXILIARY_WORD_NUM * sizeof(uint64_t));
+        if (!out) {
+            throw std::runtime_error("failed to write sketch");
+        }
+    }
+
+    // Replaces the contents of this sketch. Throws std::runtime_error on a
+    // truncated stream or a header that does not match this sketch type, and
+    // then leaves the sketch as it was: the data is read into scratch
+    // buffers (one sketch's worth of memory) and copied in only once whole.
+    void deserialize(std::istream& in) {
+        SketchFileHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            throw std::runtime_error("truncated sketch header");
+        }
+        check_header(header);
+
+        std::unique_ptr<Bucket[]> buckets(new Bucket[BucketNum]);
+        std::unique_ptr<uint64_t[]> auxiliary_list(new uint64_t[AUXILIARY_WORD_NUM]);
+        char padding[SketchFileHeader::ALIGNMENT];
+        in.read(padding, header.buckets_offset - sizeof(header));
+        in.read(reinterpret_cast<char*>(buckets.get()), sizeof(Bucket) * uint64_t(BucketNum));
+        in.read(padding, header.auxiliary_offset - header.buckets_offset - sizeof(Bucket) * uint64_t(BucketNum));
+        in.read(reinterpret_cast<char*>(auxiliary_list.get()), AUXILIARY_WORD_NUM * sizeof(uint64_t));
+        if (!in) {
+            throw std::runtime_error("truncated sketch data");
+        }
 
-            bit_idx += to_extract_bits_num;
-            slot_word_idx = bit_idx / 64;
-            slot_bit_idx_in_word = bit_idx % 64;
+        memcpy(static_cast<void*>(buckets_), buckets.get(), sizeof(Bucket) * size_t(BucketNum));
+        uint64_t* previous = auxiliary_list_;
+        auxiliary_list_ = auxiliary_list.release();
+        auxiliary_list.reset(previous);
+    }
 
-            extracted_bits_num += to_extract_bits_num;
-            lp_word_idx = extracted_bits_num / 64;
-            lp_bit_in_word = extracted_bits_num % 64;
+    void save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("cannot open " + path);
         }
+        serialize(out);
+    }
 
-        counter = left_part[lp_word_idx] >> (lp_bit_in_word - 2);
-        left_part[lp_word_idx] &= ~((uint64_t)3 << (lp_bit_in_word - 2));
-        return counter;
+    void load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("cannot open " + path);
+        }
+        deserialize(in);
     }
 
-    void set_left_part(uint32_t slot_idx, const uint64_t* left_part) {
-        unsigned int bit_idx = slot_idx * (LeftPartBits + Config::EXTRA_BITS_NUM);
-        unsigned int slot_word_idx = bit_idx / 64;
-        unsigned int slot_bit_idx_in_word = bit_idx % 64;
-
-        unsigned int extracted_bits_num = 0;
-        unsigned int lp_word_idx = 0;
-        unsigned int lp_bit_in_word = 0;
-
-        while (extracted_bits_num < LeftPartBits) {
-            unsigned int to_extract_bits_num = std::min(LeftPartBits - extracted_bits_num, 64u - lp_bit_in_word);
-            to_extract_bits_num = std::min(to_extract_bits_num, 64u - slot_bit_idx_in_word);
-
-            uint64_t extract_part;
-            if (to_extract_bits_num == 64) {
-                extract_part = left_part[lp_word_idx];
-                auxiliary_list_[slot_word_idx] = extract_part;
-            } else {
-                uint64_t extract_part_mask = ((uint64_t)1 << to_extract_bits_num) - 1;
-                extract_part = (left_part[lp_word_idx] >> lp_bit_in_word) & extract_part_mask;
-                auxiliary_list_[slot_word_idx] &= ~(extract_part_mask << slot_bit_idx_in_word);
-                auxiliary_list_[slot_word_idx] |= extract_part << slot_bit_idx_in_word;
+    // Read-only sketch answering queries straight from a mapped snapshot
+    // written by save(), without copying it into memory first
+    class View {
+    public:
+        explicit View(const std::string& path) : file_(path) {
+            if (file_.size() < sizeof(SketchFileHeader)) {
+                throw std::runtime_error("truncated sketch header: " + path);
+            }
+            SketchFileHeader header;
+            memcpy(&header, file_.data(), sizeof(header));
+            check_header(header);
+            if (file_.size() < header.file_size) {
+                throw std::runtime_error("truncated sketch data: " + path);
             }
+            buckets_ = reinterpret_cast<const Bucket*>(file_.data() + header.buckets_offset);
+            auxiliary_list_ = reinterpret_cast<const uint64_t*>(file_.data() + header.auxiliary_offset);
+        }
 
-            bit_idx += to_extract_bits_num;
-            slot_word_idx = bit_idx / 64;
-            slot_bit_idx_in_word = bit_idx % 64;
+        uint32_t query(const KeyType& key) const {
+            uint32_t bucket_idx;
+            uint16_t fp;
+            uint64_t left_part[LEFT_PART_WORDS] = {0};
+            KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+            return Sketch::lookup(buckets_, auxiliary_list_, bucket_idx, fp, left_part);
+        }
 
-            extracted_bits_num += to_extract_bits_num;
-            lp_word_idx = extracted_bits_num / 64;
-            lp_bit_in_word = extracted_bits_num % 64;
+        std::vector<FlowInfo> get_heavy_flows() const {
+            return collect_heavy_flows(buckets_, auxiliary_list_, [](uint32_t, uint32_t count) { return count; });
         }
+
+        std::vector<FlowInfo> top_k(size_t k) const {
+            return collect_top_k(buckets_, auxiliary_list_, k);
+        }
+
+    private:
+        MappedFile file_;
+        const Bucket* buckets_;
+        const uint64_t* auxiliary_list_;
+    };
+
+    static View view(const std::string& path) {
+        return View(path);
     }
 
-    void set_left_part_counter(uint32_t slot_idx, uint8_t counter) {
-        unsigned int bit_idx = slot_idx * (LeftPartBits + Config::EXTRA_BITS_NUM) + LeftPartBits;
-        unsigned int slot_word_idx = bit_idx / 64;
-        unsigned int slot_bit_idx_in_word = bit_idx % 64;
-        unsigned int extracted_bits_num = 0;
+    // Copy of the raw buckets and auxiliary list, decoded on demand. Taking
+    // one is a plain memory copy, so a caller that locks the sketch can copy
+    // it and leave the scan, decode and sort of get_heavy_flows to after
+    // the lock is released.
+    class Snapshot {
+    public:
+        explicit Snapshot(const Sketch& sketch)
+            : buckets_(new Bucket[BucketNum]), auxiliary_list_(new uint64_t[AUXILIARY_WORD_NUM]) {
+            memcpy(static_cast<void*>(buckets_.get()), sketch.buckets_, sizeof(Bucket) * size_t(BucketNum));
+            memcpy(auxiliary_list_.get(), sketch.auxiliary_list_, AUXILIARY_WORD_NUM * sizeof(uint64_t));
+        }
+
+        std::vector<FlowInfo> get_heavy_flows() const {
+            return collect_heavy_flows(buckets_.get(), auxiliary_list_.get(),
+                                       [](uint32_t, uint32_t count) { return count; });
+        }
+
+        std::vector<FlowInfo> top_k(size_t k) const {
+            return collect_top_k(buckets_.get(), auxiliary_list_.get(), k);
+        }
+
+    private:
+        std::unique_ptr<Bucket[]> buckets_;
+        std::unique_ptr<uint64_t[]> auxiliary_list_;
+    };
 
-        while (extracted_bits_num < Config::EXTRA_BITS_NUM) {
-            unsigned int to_extract_bits_num = std::min(Config::EXTRA_BITS_NUM - extracted_bits_num, 64u - slot_bit_idx_in_word);
-            uint64_t extract_part_mask = ((uint64_t)1 << to_extract_bits_num) - 1;
-            uint64_t extract_part = (counter >> extracted_bits_num) & extract_part_mask;
+    Snapshot snapshot() const {
+        return Snapshot(*this);
+    }
 
-            auxiliary_list_[slot_word_idx] &= ~(extract_part_mask << slot_bit_idx_in_word);
-            auxiliary_list_[slot_word_idx] |= extract_part << slot_bit_idx_in_word;
+    // Buckets per merge range such that ranges starting at multiples of it
+    // never share an auxiliary-list word with a neighbouring range
+    static constexpr uint32_t MERGE_GRANULARITY = Layout::COLOCATED ? 1 :
+        Codec::WORD_ALIGNED_SLOTS / std::gcd<uint64_t, uint64_t>(CellNumH, Codec::WORD_ALIGNED_SLOTS);
+
+    // Fold another sketch with identical parameters (e.g. from another
+    // collector) into this one. Within each bucket, heavy cells with the same
+    // fingerprint and left part sum, light cells with the same fingerprint
+    // sum, and the rest compete for cells as in insert(): the largest heavy
+    // counters keep heavy cells, displaced heavy flows fall back to light
+    // cells, and the smallest counters are evicted.
+    void merge(const Sketch& other) {
+        merge(other, 0, BucketNum);
+    }
 
-            bit_idx += to_extract_bits_num;
-            slot_word_idx = bit_idx / 64;
-            slot_bit_idx_in_word = bit_idx % 64;
-            extracted_bits_num += to_extract_bits_num;
+    // Merge buckets [begin_bucket, end_bucket) only. Ranges may be merged
+    // concurrently when their bounds are multiples of MERGE_GRANULARITY.
+    void merge(const Sketch& other, uint32_t begin_bucket, uint32_t end_bucket) {
+        for (uint32_t bucket_idx = begin_bucket; bucket_idx < end_bucket; bucket_idx++) {
+            merge_bucket(other, bucket_idx);
         }
     }
 
-public:
-    struct FlowInfo {
-        KeyType key;
-        uint32_t count;
-        
-        bool operator<(const FlowInfo& other) const {
-            return count > other.count;
+    void merge_parallel(const Sketch& other, size_t thread_num) {
+        uint32_t chunk_num = (BucketNum + MERGE_GRANULARITY - 1) / MERGE_GRANULARITY;
+        thread_num = std::max<size_t>(1, std::min<size_t>(thread_num, chunk_num));
+        std::vector<std::thread> workers;
+        workers.reserve(thread_num);
+        for (size_t t = 0; t < thread_num; t++) {
+            uint32_t begin = std::min<uint64_t>(BucketNum, uint64_t(chunk_num * t / thread_num) * MERGE_GRANULARITY);
+            uint32_t end = std::min<uint64_t>(BucketNum, uint64_t(chunk_num * (t + 1) / thread_num) * MERGE_GRANULARITY);
+            workers.emplace_back([this, &other, begin, end] { merge(other, begin, end); });
         }
-    };
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
 
-    std::vector<FlowInfo> get_heavy_flows() const {
+private:
+    static constexpr size_t MAX_BATCH = 256;
+
+    static_assert(std::is_trivially_copyable_v<Bucket>, "buckets are serialized as raw bytes");
+
+    static SketchFileHeader make_header() {
+        SketchFileHeader header{};
+        memcpy(header.magic, SketchFileHeader::MAGIC, sizeof(header.magic));
+        header.version = SketchFileHeader::VERSION;
+        header.byte_order = SketchFileHeader::ENDIAN_MARK;
+        header.key_size = static_cast<uint32_t>(KeyType::SIZE);
+        header.bucket_num = BucketNum;
+        header.left_part_bits = LeftPartBits;
+        header.cell_num_h = CellNumH;
+        header.cell_num_l = CellNumL;
+        header.layout_id = Layout::FORMAT_ID;
+        header.bucket_size = sizeof(Bucket);
+        header.buckets_offset = SketchFileHeader::align(sizeof(SketchFileHeader));
+        header.auxiliary_offset = SketchFileHeader::align(header.buckets_offset + sizeof(Bucket) * uint64_t(BucketNum));
+        header.auxiliary_word_num = AUXILIARY_WORD_NUM;
+        header.file_size = SERIALIZED_SIZE;
+        return header;
+    }
+
+    static void check_header(const SketchFileHeader& header) {
+        if (memcmp(header.magic, SketchFileHeader::MAGIC, sizeof(header.magic)) != 0) {
+            throw std::runtime_error("not a serialized sketch");
+        }
+        if (header.version != SketchFileHeader::VERSION) {
+            throw std::runtime_error("unsupported sketch format version " + std::to_string(header.version));
+        }
+        if (header.byte_order != SketchFileHeader::ENDIAN_MARK) {
+            throw std::runtime_error("sketch was written with a different byte order");
+        }
+        const SketchFileHeader expected = make_header();
+        if (memcmp(&header, &expected, sizeof(header)) != 0) {
+            throw std::runtime_error("serialized sketch parameters do not match this Sketch type");
+        }
+    }
+
+    template<typename Adjust>
+    static std::vector<FlowInfo> collect_heavy_flows(const Bucket* buckets, const uint64_t* auxiliary_list,
+                                                     Adjust adjust) {
         std::vector<FlowInfo> flows;
         flows.reserve(BucketNum * CellNumH);
 
         for (uint32_t bucket_idx = 0; bucket_idx < BucketNum; bucket_idx++) {
+            const auto& bucket = buckets[bucket_idx];
             for (uint32_t i = 0; i < CellNumH; i++) {
-                const auto& cell = buckets_[bucket_idx][i];
-                if (cell.c > 0) {
+                uint32_t count = bucket.count(i) > 0 ? adjust(bucket_idx, bucket.count(i)) : 0;
+                if (count > 0) {
                     FlowInfo flow;
-                    uint64_t left_part[2] = {0};
-                    get_left_part(bucket_idx * CellNumH + i, left_part);
-                    KeyHasher<KeyType, BucketNum>::combine_key(flow.key, bucket_idx, cell.fp, left_part);
-                    flow.count = cell.c;
+                    uint64_t left_part[LEFT_PART_WORDS] = {0};
+                    get_left_part(buckets, auxiliary_list, bucket_idx * CellNumH + i, left_part);
+                    KeyHasher<KeyType, BucketNum>::combine_key(flow.key, bucket_idx, bucket.fp(i), left_part);
+                    flow.count = count;
                     flows.push_back(flow);
                 }
             }
@@ -525,187 +811,389 @@ public:
         return flows;
     }
 
-    Sketch() : rng_(std::chrono::steady_clock::now().time_since_epoch().count()) {
-        uint32_t auxiliary_word_num = static_cast<uint32_t>(
-            std::ceil(BucketNum * CellNumH * (LeftPartBits + Config::EXTRA_BITS_NUM) / 64.0));
-        auxiliary_list_ = new uint64_t[auxiliary_word_num]();
-    }
+    static std::vector<FlowInfo> collect_top_k(const Bucket* buckets, const uint64_t* auxiliary_list, size_t k) {
+        // Min-heap of the k largest (count, slot) pairs seen so far; most
+        // cells fail the comparison against its root
+        using Candidate = std::pair<uint32_t, uint32_t>;
+        auto heavier = [](const Candidate& a, const Candidate& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        };
+        if (k == 0) {
+            return {};
+        }
+        std::vector<Candidate> heap;
+        heap.reserve(std::min<size_t>(k, size_t(BucketNum) * CellNumH));
 
-    ~Sketch() {
-        delete[] auxiliary_list_;
+        for (uint32_t bucket_idx = 0; bucket_idx < BucketNum; bucket_idx++) {
+            const auto& bucket = buckets[bucket_idx];
+            for (uint32_t i = 0; i < CellNumH; i++) {
+                uint32_t count = bucket.count(i);
+                if (count == 0 || (heap.size() == k && count <= heap.front().first)) {
+                    continue;
+                }
+                if (heap.size() == k) {
+                    std::pop_heap(heap.begin(), heap.end(), heavier);
+                    heap.back() = {count, bucket_idx * CellNumH + i};
+                } else {
+                    heap.emplace_back(count, bucket_idx * CellNumH + i);
+                }
+                std::push_heap(heap.begin(), heap.end(), heavier);
+            }
+        }
+
+        std::sort(heap.begin(), heap.end(), heavier);
+        std::vector<FlowInfo> flows(heap.size());
+        for (size_t j = 0; j < heap.size(); j++) {
+            uint32_t bucket_idx = heap[j].second / CellNumH;
+            uint64_t left_part[LEFT_PART_WORDS] = {0};
+            get_left_part(buckets, auxiliary_list, heap[j].second, left_part);
+            KeyHasher<KeyType, BucketNum>::combine_key(flows[j].key, bucket_idx,
+                                                       buckets[bucket_idx].fp(heap[j].second % CellNumH), left_part);
+            flows[j].count = heap[j].first;
+        }
+        return flows;
     }
 
-    void insert(const KeyType& key) {
-        uint32_t bucket_idx;
+    struct MergeCell {
+        uint32_t c;
         uint16_t fp;
-        uint64_t left_part[2] = {0};
-        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+        uint8_t extra_counter;
+        bool dirty;           // extra counter changed, or left part must be written
+        uint64_t left_part[LEFT_PART_WORDS];
+    };
 
-        uint32_t matched_idx = UINT32_MAX;
-        uint32_t matched_counter = 0;
-        uint32_t smallest_heavy_idx = 0;
-        uint16_t smallest_heavy_fp = 0;
-        uint32_t smallest_heavy_counter = UINT32_MAX;
+    static bool is_empty(const Bucket& bucket) {
+        for (uint32_t i = 0; i < CellNumH + CellNumL; i++) {
+            if (bucket.count(i) > 0) return false;
+        }
+        return true;
+    }
 
-        // Check heavy cells
-        for (uint32_t i = 0; i < CellNumH; i++) {
-            auto& cell = buckets_[bucket_idx][i];
-            
-            if (cell.c == 0) {
-                cell.fp = fp;
-                cell.c = 1;
-                set_left_part(bucket_idx * CellNumH + i, left_part);
-                return;
-            }
+    static uint32_t saturating_add(uint32_t a, uint32_t b) {
+        return static_cast<uint32_t>(std::min<uint64_t>(uint64_t(a) + b, UINT32_MAX));
+    }
+
+    // Partitions candidate indices so the CellNum largest counters come
+    // first; ties prefer the lower index, so the split is deterministic.
+    // Only the split matters to assign(), so no full sort is needed.
+    template<uint32_t CellNum, typename Cell>
+    static void rank(const Cell* cells, uint32_t num, uint32_t* order) {
+        for (uint32_t k = 0; k < num; k++) {
+            order[k] = k;
+        }
+        if (num > CellNum) {
+            std::nth_element(order, order + CellNum, order + num, [cells](uint32_t a, uint32_t b) {
+                return cells[a].c != cells[b].c ? cells[a].c > cells[b].c : a < b;
+            });
+        }
+    }
 
-            if (fp == cell.fp) {
-                matched_idx = i;
-                matched_counter = cell.c;
-                break;
+    // Candidates [0, CellNum) mirror the bucket's own cells; survivors stay
+    // in place and newcomers take the cells that were freed
+    template<uint32_t CellNum, typename Cell, typename Place>
+    static void assign(const Cell* cells, uint32_t num, const uint32_t* order, Place&& place) {
+        bool kept[CellNum] = {};
+        const uint32_t candidates = std::min(num, CellNum);
+        for (uint32_t k = 0; k < candidates; k++) {
+            if (order[k] < CellNum && cells[order[k]].c > 0) {
+                kept[order[k]] = true;
             }
+        }
 
-            if (cell.c < smallest_heavy_counter) {
-                smallest_heavy_idx = i;
-                smallest_heavy_fp = cell.fp;
-                smallest_heavy_counter = cell.c;
+        uint32_t free_pos = 0;
+        for (uint32_t k = 0; k < candidates; k++) {
+            uint32_t idx = order[k];
+            if (cells[idx].c == 0) {
+                continue;
+            }
+            if (idx < CellNum) {
+                place(idx, idx);
+            } else {
+                while (kept[free_pos]) free_pos++;
+                kept[free_pos] = true;
+                place(free_pos, idx);
             }
         }
+        for (uint32_t pos = 0; pos < CellNum; pos++) {
+            if (!kept[pos]) {
+                place(pos, UINT32_MAX);
+            }
+        }
+    }
 
-        uint32_t smallest_idx = smallest_heavy_idx;
-        uint32_t smallest_counter = smallest_heavy_counter;
+    void merge_bucket(const Sketch& other, uint32_t bucket_idx) {
+        auto& bucket = buckets_[bucket_idx];
+        const auto& other_bucket = other.buckets_[bucket_idx];
 
-        if (matched_idx == UINT32_MAX) {
-            for (uint32_t i = CellNumH; i < CellNumH + CellNumL; i++) {
-                auto& cell = buckets_[bucket_idx][i];
+        if (is_empty(other_bucket)) {
+            return;
+        }
 
+        // heavy[i] mirrors heavy cell i, and its fingerprint is copied into a
+        // flat array so match masks index the candidates directly. Own left
+        // parts are only decoded on a fingerprint hit.
+        MergeCell heavy[2 * CellNumH];
+        uint16_t heavy_fp[CellNumH];
+        bool decoded[CellNumH] = {};
+        uint32_t heavy_num = CellNumH;
+        for (uint32_t i = 0; i < CellNumH; i++) {
+            heavy[i].c = bucket.count(i);
+            heavy[i].fp = heavy_fp[i] = bucket.fp(i);
+            heavy[i].dirty = false;
+        }
+
+        for (uint32_t j = 0; j < CellNumH; j++) {
+            if (other_bucket.count(j) == 0) {
+                continue;
+            }
+            MergeCell& incoming = heavy[heavy_num];
+            incoming.c = other_bucket.count(j);
+            incoming.fp = other_bucket.fp(j);
+            incoming.dirty = true;
+            incoming.extra_counter = other.get_left_part(bucket_idx * CellNumH + j, incoming.left_part);
+
+            bool merged = false;
+            for (uint64_t mask = simd::match_epi16<CellNumH>(heavy_fp, incoming.fp); mask; mask &= mask - 1) {
+                uint32_t i = static_cast<uint32_t>(__builtin_ctzll(mask));
+                MergeCell& cell = heavy[i];
                 if (cell.c == 0) {
-                    cell.fp = fp;
-                    cell.c = 1;
-                    return;
+                    continue;
                 }
-
-                if (fp == cell.fp) {
-                    matched_idx = i;
-                    matched_counter = cell.c;
+                if (!decoded[i]) {
+                    cell.extra_counter = get_left_part(bucket_idx * CellNumH + i, cell.left_part);
+                    decoded[i] = true;
+                }
+                if (auxiliary::same_left_part(cell.left_part, incoming.left_part, LeftPartBits)) {
+                    cell.c = saturating_add(cell.c, incoming.c);
+                    if (incoming.extra_counter > cell.extra_counter) {
+                        cell.extra_counter = incoming.extra_counter;
+                        cell.dirty = true;
+                    }
+                    merged = true;
                     break;
                 }
+            }
+            if (!merged) {
+                heavy_num++;
+            }
+        }
 
-                if (cell.c < smallest_counter) {
-                    smallest_idx = i;
-                    smallest_counter = cell.c;
+        // Light cells carry no left part: they merge on the fingerprint, and
+        // heavy flows that lose their cell compete for light cells with it.
+        // Fingerprints are mirrored into a flat array so lookups stay SIMD
+        // compares regardless of the bucket layout.
+        struct LightCell {
+            uint32_t c;
+            uint16_t fp;
+        };
+        constexpr uint32_t LIGHT_CAPACITY = 2 * CellNumL + 2 * CellNumH;
+        LightCell light[LIGHT_CAPACITY];
+        uint16_t light_fp[(LIGHT_CAPACITY + 63) / 64 * 64] = {};
+        uint32_t light_num = CellNumL;
+        for (uint32_t i = 0; i < CellNumL; i++) {
+            light[i].c = bucket.count(CellNumH + i);
+            light[i].fp = light_fp[i] = bucket.fp(CellNumH + i);
+        }
+        auto add_light = [&](uint16_t fp, uint32_t c) {
+            for (uint32_t base = 0; base < light_num; base += 64) {
+                uint64_t mask = simd::match_epi16<64>(light_fp + base, fp);
+                if (light_num - base < 64) {
+                    mask &= (uint64_t(1) << (light_num - base)) - 1;
+                }
+                for (; mask; mask &= mask - 1) {
+                    LightCell& cell = light[base + __builtin_ctzll(mask)];
+                    if (cell.c > 0) {
+                        cell.c = saturating_add(cell.c, c);
+                        return;
+                    }
                 }
             }
+            light_fp[light_num] = fp;
+            light[light_num++] = {c, fp};
+        };
+        for (uint32_t i = CellNumH; i < CellNumH + CellNumL; i++) {
+            if (other_bucket.count(i) > 0) {
+                add_light(other_bucket.fp(i), other_bucket.count(i));
+            }
+        }
+
+        uint32_t order[2 * CellNumH];
+        rank<CellNumH>(heavy, heavy_num, order);
+        for (uint32_t k = CellNumH; k < heavy_num; k++) {
+            if (heavy[order[k]].c > 0) {
+                add_light(heavy[order[k]].fp, heavy[order[k]].c);
+            }
+        }
+
+        assign<CellNumH>(heavy, heavy_num, order, [&](uint32_t pos, uint32_t idx) {
+            uint32_t slot_idx = bucket_idx * CellNumH + pos;
+            if (idx == UINT32_MAX) {
+                bucket.set(pos, 0, 0);
+                return;
+            }
+            const MergeCell& cell = heavy[idx];
+            bucket.set(pos, cell.fp, cell.c);
+            if (idx != pos) {
+                set_left_part(slot_idx, cell.left_part);
+                set_left_part_counter(slot_idx, cell.extra_counter);
+            } else if (cell.dirty) {
+                set_left_part_counter(slot_idx, cell.extra_counter);
+            }
+        });
+
+        uint32_t light_order[2 * CellNumL + 2 * CellNumH];
+        rank<CellNumL>(light, light_num, light_order);
+        assign<CellNumL>(light, light_num, light_order, [&](uint32_t pos, uint32_t idx) {
+            if (idx == UINT32_MAX) {
+                bucket.set(CellNumH + pos, 0, 0);
+            } else {
+                bucket.set(CellNumH + pos, light[idx].fp, light[idx].c);
+            }
+        });
+    }
+
+    void prefetch_bucket(uint32_t bucket_idx) const {
+        const char* bucket = reinterpret_cast<const char*>(&buckets_[bucket_idx]);
+        for (size_t offset = 0; offset < sizeof(Bucket); offset += 64) {
+            __builtin_prefetch(bucket + offset, 1);
         }
 
-        if (matched_idx == UINT32_MAX) {
-            if (rng_() % smallest_counter == 0) {
-                auto& cell = buckets_[bucket_idx][smallest_idx];
-                cell.fp = fp;
+        if constexpr (!Layout::COLOCATED) {
+            __builtin_prefetch(auxiliary_list_ + Codec::slot_bit(uint64_t(bucket_idx) * CellNumH) / 64, 1);
+        }
+    }
+
+    // Adds weight (>= 1) to the key as weight packets in a row would, in
+    // one pass. Returns the key's heavy counter after the update, or 0 if
+    // it ended up in a light cell or was not admitted.
+    uint32_t update(uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part, uint32_t weight) {
+        auto& bucket = buckets_[bucket_idx];
+        JIGSAW_STAT(stats_, inserts);
+
+        // Check heavy cells: the first empty or matching cell wins
+        uint32_t matched_idx = bucket.template find<0, CellNumH>(fp);
+        if (matched_idx < CellNumH && bucket.count(matched_idx) == 0) {
+            JIGSAW_STAT(stats_, empty_fills);
+            bucket.set(matched_idx, fp, weight);
+            set_left_part(bucket_idx * CellNumH + matched_idx, left_part);
+            return bucket.count(matched_idx);
+        }
+
+        uint32_t smallest_heavy_idx = 0;
+        uint32_t smallest_heavy_counter = UINT32_MAX;
+
+        if (matched_idx == CellNumH) {
+            smallest_heavy_idx = bucket.template smallest<0, CellNumH>();
+            smallest_heavy_counter = bucket.count(smallest_heavy_idx);
+
+            matched_idx = bucket.template find<CellNumH, CellNumH + CellNumL>(fp);
+            if (matched_idx < CellNumH + CellNumL && bucket.count(matched_idx) == 0) {
+                JIGSAW_STAT(stats_, empty_fills);
+                bucket.set(matched_idx, fp, weight);
+                return 0;
+            }
+        }
+
+        if (matched_idx == CellNumH + CellNumL) {
+            uint32_t smallest_idx = smallest_heavy_idx;
+            uint32_t smallest_counter = smallest_heavy_counter;
+            uint32_t smallest_light_idx = bucket.template smallest<CellNumH, CellNumH + CellNumL>();
+            if (bucket.count(smallest_light_idx) < smallest_counter) {
+                smallest_idx = smallest_light_idx;
+                smallest_counter = bucket.count(smallest_light_idx);
+            }
+
+            // Each of the weight packets would take the cell with probability
+            // 1 / smallest_counter; the one that does inherits the counter and
+            // the rest count as matches
+            if (one_in(static_cast<uint32_t>(rng_()), smallest_counter, weight)) {
+                JIGSAW_STAT(stats_, replacements);
+                const uint32_t counter = saturating_add(smallest_counter, weight - 1);
+                bucket.set(smallest_idx, fp, counter);
                 if (smallest_idx < CellNumH) {
                     set_left_part(bucket_idx * CellNumH + smallest_idx, left_part);
+                    return bucket.count(smallest_idx);
                 }
+            } else {
+                JIGSAW_STAT(stats_, replacements_rejected);
             }
-        } else {
-            auto& matched_cell = buckets_[bucket_idx][matched_idx];
-            
-            if (matched_idx >= CellNumH) {
-                if (matched_counter >= smallest_heavy_counter) {
-                    matched_cell.fp = smallest_heavy_fp;
-                    matched_cell.c = smallest_heavy_counter;
-                    
-                    auto& heavy_cell = buckets_[bucket_idx][smallest_heavy_idx];
-                    heavy_cell.fp = fp;
-                    heavy_cell.c = matched_counter + 1;
-                    
-                    set_left_part(bucket_idx * CellNumH + smallest_heavy_idx, left_part);
-                    return;
-                }
+            return 0;
+        }
+        if (matched_idx >= CellNumH + CellNumL) __builtin_unreachable();  // returned just above
+
+        uint32_t matched_counter = bucket.count(matched_idx);
+
+        if (matched_idx >= CellNumH) {
+            JIGSAW_STAT(stats_, light_matches);
+            if (matched_counter >= smallest_heavy_counter) {
+                JIGSAW_STAT(stats_, promotions);
+                bucket.set(matched_idx, bucket.fp(smallest_heavy_idx), smallest_heavy_counter);
+                bucket.set(smallest_heavy_idx, fp, saturating_add(matched_counter, weight));
+
+                set_left_part(bucket_idx * CellNumH + smallest_heavy_idx, left_part);
+                return bucket.count(smallest_heavy_idx);
             }
-            
-            matched_cell.c++;
-            
-            if (matched_idx < CellNumH && 
-                (matched_cell.c == 512 || (matched_cell.c > 512 && rng_() % 512 == 0))) {
-                
-                uint32_t slot_idx = bucket_idx * CellNumH + matched_idx;
-                uint64_t target_left_part[2] = {0};
-                uint8_t extra_counter = get_left_part(slot_idx, target_left_part);
-                
-                if (memcmp(left_part, target_left_part, COM_BYTES) != 0) {
-                    if (extra_counter > 0) {
-                        set_left_part_counter(slot_idx, extra_counter - 1);
-                    } else {
-                        set_left_part(slot_idx, left_part);
-                    }
-                } else if (extra_counter != (1 << Config::EXTRA_BITS_NUM) - 1) {
-                    set_left_part_counter(slot_idx, extra_counter + 1);
+        } else {
+            JIGSAW_STAT(stats_, heavy_matches);
+        }
+
+        const uint32_t previous_counter = matched_counter;
+        bucket.set_count(matched_idx, saturating_add(matched_counter, weight));
+        matched_counter = bucket.count(matched_idx);
+
+        // Verify the left part when the counter crosses 512, then about once
+        // per 512 packets
+        if (matched_idx < CellNumH &&
+            (previous_counter < 512 ? matched_counter >= 512 : (rng_() & 511) < weight)) {
+
+            uint32_t slot_idx = bucket_idx * CellNumH + matched_idx;
+            uint64_t target_left_part[LEFT_PART_WORDS] = {0};
+            uint8_t extra_counter = get_left_part(slot_idx, target_left_part);
+            JIGSAW_STAT(stats_, verifications);
+
+            if (!auxiliary::same_left_part(left_part, target_left_part, LeftPartBits)) {
+                if (extra_counter > 0) {
+                    JIGSAW_STAT(stats_, extra_decrements);
+                    set_left_part_counter(slot_idx, extra_counter - 1);
+                } else {
+                    JIGSAW_STAT(stats_, left_part_rewrites);
+                    set_left_part(slot_idx, left_part);
                 }
+            } else if (extra_counter != (1 << Config::EXTRA_BITS_NUM) - 1) {
+                JIGSAW_STAT(stats_, extra_increments);
+                set_left_part_counter(slot_idx, extra_counter + 1);
             }
         }
+        return matched_idx < CellNumH ? matched_counter : 0;
     }
 
-    uint32_t query(const KeyType& key) {
-        uint32_t bucket_idx;
-        uint16_t fp;
-        uint64_t left_part[2] = {0};
-        KeyHasher<KeyType, BucketNum>::divide_key(key, bucket_idx, fp, left_part);
+    uint32_t lookup(uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) const {
+        JIGSAW_STAT(stats_, queries);
+        return lookup(buckets_, auxiliary_list_, bucket_idx, fp, left_part);
+    }
+
+    static uint32_t lookup(const Bucket* buckets, const uint64_t* auxiliary_list,
+                           uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+        const auto& bucket = buckets[bucket_idx];
 
         // Check heavy cells first
-        for (uint32_t i = 0; i < CellNumH; i++) {
-            const auto& cell = buckets_[bucket_idx][i];
-            if (cell.fp == fp) {
-                uint64_t target_left_part[2] = {0};
-                uint8_t extra_counter = get_left_part(bucket_idx * CellNumH + i, target_left_part);
-                if (memcmp(left_part, target_left_part, COM_BYTES) == 0) {
-                    return cell.c * (extra_counter + 1);
-                }
+        for (uint64_t mask = bucket.template match<0, CellNumH>(fp); mask; mask &= mask - 1) {
+            uint32_t i = static_cast<uint32_t>(__builtin_ctzll(mask));
+            uint64_t target_left_part[LEFT_PART_WORDS] = {0};
+            get_left_part(buckets, auxiliary_list, bucket_idx * CellNumH + i, target_left_part);
+            if (auxiliary::same_left_part(left_part, target_left_part, LeftPartBits)) {
+                return bucket.count(i);
             }
         }
 
         // Check light cells
-        for (uint32_t i = CellNumH; i < CellNumH + CellNumL; i++) {
-            const auto& cell = buckets_[bucket_idx][i];
-            if (cell.fp == fp) {
-                return cell.c;
-            }
+        uint64_t light_mask = bucket.template match<CellNumH, CellNumH + CellNumL>(fp);
+        if (light_mask) {
+            return bucket.count(CellNumH + static_cast<uint32_t>(__builtin_ctzll(light_mask)));
         }
 
         return 0;
     }
-
-private:
-    void combine_key(uint8_t* key, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) const {
-        if constexpr (Config::KEY_SIZE <= 16) {
-            // Reverse the transformation for small keys
-            uint64_t temp[2];
-            temp[0] = left_part[0] & Config::MI_MASK;
-            temp[1] = left_part[1];
-            
-            uint64_t part1 = (temp[0] * Config::MI_A_INV) & Config::MI_MASK;
-            uint64_t part2 = ((temp[1] << 12) + (temp[0] >> 52)) * Config::MI_A_INV & Config::MI_MASK;
-            
-            memcpy(key, &part1, 8);
-            memcpy(key + 8, &part2, Config::KEY_SIZE - 8);
-        }
-        else if constexpr (Config::KEY_SIZE <= 32) {
-            // Reverse transformation for IPv6-sized keys
-            uint64_t parts[4];
-            parts[0] = (left_part[0] & Config::MI_MASK) * Config::MI_A_INV;
-            parts[1] = (left_part[0] >> 52) * Config::MI_A_INV;
-            parts[2] = (left_part[1] & Config::MI_MASK) * Config::MI_A_INV;
-            parts[3] = (left_part[1] >> 52) * Config::MI_A_INV;
-            
-            memcpy(key, parts, Config::KEY_SIZE);
-        }
-        else {
-            // Fallback for larger keys
-            uint64_t blocks[4] = {bucket_idx, fp, left_part[0], left_part[1]};
-            for (int i = 0; i < 4; i += 2) {
-                SpeckCipher::decrypt_block(blocks[i], blocks[i+1]);
-            }
-            memcpy(key, blocks, Config::KEY_SIZE);
-        }
-    }
 };
 
 } // namespace jigsaw 
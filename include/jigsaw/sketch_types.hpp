@@ -4,28 +4,40 @@
 namespace jigsaw {
 
 // Common sketch configurations
-using SmallSketch = Sketch<IPv4Flow, 1024, 79, 8, 8>;      // ~16KB memory
-using MediumSketch = Sketch<IPv4Flow, 4096, 79, 16, 16>;   // ~128KB memory
-using LargeSketch = Sketch<IPv4Flow, 16384, 79, 32, 32>;   // ~1MB memory
+using SmallSketch = Sketch<IPv4Flow, 1024, 79, 8, 8>;      // ~210KB memory
+using MediumSketch = Sketch<IPv4Flow, 4096, 79, 16, 16>;   // ~1.6MB memory
+using LargeSketch = Sketch<IPv4Flow, 16384, 79, 32, 32>;   // ~13MB memory
+
+// Same configurations with vectorized (struct-of-arrays) bucket probing
+using MediumSoASketch = Sketch<IPv4Flow, 4096, 79, 16, 16, SoALayout>;
+using LargeSoASketch = Sketch<IPv4Flow, 16384, 79, 32, 32, SoALayout>;
+
+// SoA buckets with a cache-line padded auxiliary list
+using MediumPaddedSketch = Sketch<IPv4Flow, 4096, 79, 16, 16, PaddedSoALayout>;
+using LargePaddedSketch = Sketch<IPv4Flow, 16384, 79, 32, 32, PaddedSoALayout>;
+
+// SoA buckets carrying their own left parts (no separate auxiliary list)
+using MediumColocatedSketch = Sketch<IPv4Flow, 4096, 79, 16, 16, ColocatedLayout>;
+using LargeColocatedSketch = Sketch<IPv4Flow, 16384, 79, 32, 32, ColocatedLayout>;
 
 // Word counting sketches
 using WordSketch = Sketch<CompactStringKey, 1024, 104, 8, 8>;
 using LargeWordSketch = Sketch<CompactStringKey, 4096, 104, 16, 16>;
 
-// IPv6 sketches
-using IPv6Sketch = Sketch<IPv6Flow, 1024, 79, 8, 8>;
-using LargeIPv6Sketch = Sketch<IPv6Flow, 4096, 79, 16, 16>;
+// IPv6 sketches, with left parts wide enough to decode whole 5-tuples
+using IPv6Sketch = Sketch<IPv6Flow, 1024, KeyHasher<IPv6Flow, 1024>::LEFT_PART_BITS, 8, 8>;
+using LargeIPv6Sketch = Sketch<IPv6Flow, 4096, KeyHasher<IPv6Flow, 4096>::LEFT_PART_BITS, 16, 16>;
+
+// Bit-packed 34-bit cells (16-bit fingerprint, 18-bit saturating counter)
+using MediumPackedSketch = Sketch<IPv4Flow, 4096, 79, 16, 16, PackedLayout<>>;
+using LargePackedSketch = Sketch<IPv4Flow, 16384, 79, 32, 32, PackedLayout<>>;
 
-// Memory usage calculator
-template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL>
+// Bytes of buckets and left parts a configuration allocates, including the
+// padding of its bucket layout
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout>
 constexpr size_t SketchMemoryUsage() {
-    // Cell size: fingerprint (2 bytes) + counter (4 bytes)
-    constexpr size_t cell_size = 6;
-    // Bucket memory
-    constexpr size_t bucket_mem = BucketNum * (CellNumH + CellNumL) * cell_size;
-    // Auxiliary list memory
-    constexpr size_t aux_mem = (BucketNum * CellNumH * (LeftPartBits + Config::EXTRA_BITS_NUM) + 63) / 64 * 8;
-    return bucket_mem + aux_mem;
+    return Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout>::MEMORY_SIZE;
 }
 
 } // namespace jigsaw 
\ No newline at end of file
@@ -0,0 +1,211 @@
+#pragma once
+#include <immintrin.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "sketch.hpp"
+
+namespace jigsaw {
+
+// Word splitting for text streamed into CompactStringKey sketches. Words are
+// maximal runs of bytes other than space, \n, \t and \r, found 64 bytes at a
+// time from a whitespace bitmap instead of byte by byte. Keys are packed
+// straight from the text, with no copy or case conversion per byte, and are
+// identical to CompactStringKey(word).
+
+// Bit i set iff text[i] is whitespace; reads 64 bytes
+inline uint64_t whitespace_mask(const uint8_t* text) {
+#if defined(__AVX2__)
+    // Whitespace bytes are the only ones equal to table[byte & 15]: ' ' is
+    // 0x20, \t 0x09, \n 0x0A and \r 0x0D. Bytes >= 0x80 look up 0.
+    const __m256i table = _mm256_setr_epi8(' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0,
+                                           ' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0);
+    auto mask32 = [&](const uint8_t* p) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i spaces = _mm256_cmpeq_epi8(_mm256_shuffle_epi8(table, bytes), bytes);
+        return static_cast<uint32_t>(_mm256_movemask_epi8(spaces));
+    };
+    return mask32(text) | (uint64_t(mask32(text + 32)) << 32);
+#else
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < 64; i++) {
+        const uint8_t c = text[i];
+        mask |= uint64_t(c == ' ' || c == '\n' || c == '\t' || c == '\r') << i;
+    }
+    return mask;
+#endif
+}
+
+// CompactStringKey of the first min(length, MAX_LENGTH) bytes of word.
+// Reads 16 bytes, so word + 16 must be readable.
+inline CompactStringKey compact_string_key(const uint8_t* word, size_t length) {
+    CompactStringKey key;
+    key.length = static_cast<uint8_t>(std::min(length, size_t(CompactStringKey::MAX_LENGTH)));
+#if defined(__BMI2__)
+    static_assert(CompactStringKey::MAX_LENGTH <= 16 && CompactStringKey::BITS_PER_CHAR == 5);
+    // Encode all 16 bytes at once ((c | 0x20) - 'a', as encode_char does)
+    // and zero those past the key
+    __m128i codes = _mm_sub_epi8(_mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(word)),
+                                              _mm_set1_epi8(0x20)),
+                                 _mm_set1_epi8('a'));
+    const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    codes = _mm_and_si128(codes, _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(key.length)), lanes));
+
+    // The constructor ORs each 8-bit code in at 5 * i, so a code's top 3
+    // bits (non-letters only) overlap the next character. pext packs the
+    // low 5 bits of 8 codes into 40 bits, then the top 3 bits likewise.
+    constexpr uint64_t LOW5 = 0x1F1F1F1F1F1F1F1FULL;
+    constexpr uint64_t LOW3 = 0x0707070707070707ULL;
+    auto pack = [](uint64_t codes8) {
+        return _pext_u64(codes8, LOW5) | (_pext_u64((codes8 >> 5) & LOW3, LOW5) << 5);
+    };
+    key.data = pack(static_cast<uint64_t>(_mm_cvtsi128_si64(codes))) |
+               (pack(static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(codes, codes)))) << 40);
+#else
+    for (uint8_t i = 0; i < key.length; i++) {
+        const uint8_t code = static_cast<uint8_t>((word[i] | 0x20) - 'a');
+        key.data |= static_cast<uint64_t>(code) << (i * CompactStringKey::BITS_PER_CHAR);
+    }
+#endif
+    return key;
+}
+
+// Splits text[0, size) into words and passes their keys to
+// consume(const CompactStringKey* keys, size_t n) in batches of up to
+// batch_size, e.g. straight into Sketch::insert_batch. Returns the number of
+// words.
+template<typename Consume>
+size_t tokenize_words(const uint8_t* text, size_t size, Consume&& consume, size_t batch_size = 1024) {
+    if (batch_size == 0) {
+        throw std::invalid_argument("batch_size must be positive");
+    }
+
+    std::vector<CompactStringKey> batch(batch_size);
+    size_t batch_count = 0;
+    size_t word_num = 0;
+
+    auto emit = [&](size_t begin, size_t end) {
+        if (begin + 16 <= size) {
+            batch[batch_count] = compact_string_key(text + begin, end - begin);
+        } else {
+            // Too close to the end of the text for a 16-byte load
+            uint8_t tail[16] = {0};
+            std::memcpy(tail, text + begin, size - begin);
+            batch[batch_count] = compact_string_key(tail, end - begin);
+        }
+        if (++batch_count == batch_size) {
+            consume(batch.data(), batch_count);
+            batch_count = 0;
+        }
+        word_num++;
+    };
+
+    // Bit i of the bitmaps is byte base + i. A bit of edges marks a word's
+    // first byte, or the whitespace byte right after one; in_word carries
+    // whether the previous block ended inside a word.
+    size_t word_begin = 0;
+    uint64_t in_word = 0;
+    auto scan = [&](size_t base, uint64_t spaces) {
+        const uint64_t words = ~spaces;
+        uint64_t edges = words ^ ((words << 1) | in_word);
+        while (edges) {
+            const uint32_t i = static_cast<uint32_t>(__builtin_ctzll(edges));
+            if ((words >> i) & 1) {
+                word_begin = base + i;
+            } else {
+                emit(word_begin, base + i);
+            }
+            edges &= edges - 1;
+        }
+        in_word = words >> 63;
+    };
+
+    size_t base = 0;
+    for (; base + 64 <= size; base += 64) {
+        scan(base, whitespace_mask(text + base));
+    }
+    if (base < size) {
+        // Pad the last block with spaces, which also ends its last word
+        uint8_t block[64];
+        std::memset(block, ' ', sizeof(block));
+        std::memcpy(block, text + base, size - base);
+        scan(base, whitespace_mask(block));
+    } else if (in_word) {
+        emit(word_begin, size);
+    }
+
+    if (batch_count > 0) {
+        consume(batch.data(), batch_count);
+    }
+    return word_num;
+}
+
+// part_num consecutive [begin, end) ranges covering text[0, size), each cut
+// moved forward to a whitespace byte so no word spans two ranges. Ranges may
+// be empty.
+inline std::vector<std::pair<size_t, size_t>> split_at_whitespace(const uint8_t* text, size_t size,
+                                                                  size_t part_num) {
+    if (part_num == 0) {
+        throw std::invalid_argument("part_num must be positive");
+    }
+    auto is_space = [](uint8_t c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r'; };
+
+    std::vector<std::pair<size_t, size_t>> parts;
+    size_t begin = 0;
+    for (size_t i = 1; i <= part_num; i++) {
+        size_t end = i == part_num ? size : std::max(begin, size / part_num * i);
+        while (end < size && !is_space(text[end])) {
+            end++;
+        }
+        parts.emplace_back(begin, end);
+        begin = end;
+    }
+    return parts;
+}
+
+// tokenize_words over thread_num ranges of text in parallel, e.g. a large
+// mapped file. consume(size_t part, const CompactStringKey* keys, size_t n)
+// is called concurrently for different parts, typically inserting into a
+// per-part Sketch to merge afterwards. Returns the number of words; an
+// exception from any part is rethrown once all threads finished.
+template<typename Consume>
+size_t tokenize_words_parallel(const uint8_t* text, size_t size, size_t thread_num, Consume&& consume,
+                               size_t batch_size = 1024) {
+    const auto parts = split_at_whitespace(text, size, thread_num);
+    std::vector<size_t> word_nums(thread_num, 0);
+    std::vector<std::exception_ptr> errors(thread_num);
+    std::vector<std::thread> workers;
+    workers.reserve(thread_num);
+    for (size_t part = 0; part < thread_num; part++) {
+        workers.emplace_back([&, part] {
+            try {
+                const auto [begin, end] = parts[part];
+                word_nums[part] = tokenize_words(
+                    text + begin, end - begin,
+                    [&](const CompactStringKey* keys, size_t n) { consume(part, keys, n); }, batch_size);
+            } catch (...) {
+                errors[part] = std::current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    size_t word_num = 0;
+    for (size_t n : word_nums) {
+        word_num += n;
+    }
+    return word_num;
+}
+
+} // namespace jigsaw
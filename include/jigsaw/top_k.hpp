@@ -0,0 +1,138 @@
+#pragma once
+#include "sketch.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace jigsaw {
+
+// Running top-k over the counts Sketch::insert returns. A count only has
+// to beat the current k-th value (one comparison on the packet path);
+// membership updates scan the k entries, so keep k small (tens to a few
+// hundred).
+template<typename KeyType>
+class TopKTracker {
+public:
+    struct Entry {
+        KeyType key;
+        uint32_t count;
+    };
+
+    explicit TopKTracker(size_t k) : k_(k) {
+        if (k == 0) {
+            throw std::invalid_argument("TopKTracker needs k > 0");
+        }
+        entries_.reserve(k);
+    }
+
+    size_t k() const { return k_; }
+
+    // A count must exceed this to enter; 0 until k keys are tracked
+    uint32_t threshold() const { return threshold_; }
+
+    void offer(const KeyType& key, uint32_t count) {
+        if (count <= threshold_) {
+            return;
+        }
+
+        size_t slot = entries_.size();
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (memcmp(&entries_[i].key, &key, KeyType::SIZE) == 0) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < entries_.size()) {
+            // The new count is above the threshold, so the smallest entry
+            // changes only if it was the one updated
+            entries_[slot].count = count;
+            if (slot != smallest_) {
+                return;
+            }
+        } else if (entries_.size() < k_) {
+            entries_.push_back({key, count});
+        } else {
+            entries_[smallest_] = {key, count};
+        }
+
+        smallest_ = 0;
+        for (size_t i = 1; i < entries_.size(); i++) {
+            if (entries_[i].count < entries_[smallest_].count) {
+                smallest_ = i;
+            }
+        }
+        if (entries_.size() == k_) {
+            threshold_ = entries_[smallest_].count;
+        }
+    }
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+    void clear() {
+        entries_.clear();
+        smallest_ = 0;
+        threshold_ = 0;
+    }
+
+private:
+    size_t k_;
+    std::vector<Entry> entries_;
+    size_t smallest_ = 0;
+    uint32_t threshold_ = 0;
+};
+
+// Sketch with an incrementally maintained top-k, for dashboards that poll
+// far more often than a full heavy-flow scan could keep up with. top_k()
+// costs k lookups and never scans the buckets.
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout>
+class TopKSketch {
+public:
+    using SketchType = Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout>;
+    using FlowInfo = typename SketchType::FlowInfo;
+
+    explicit TopKSketch(size_t k) : sketch_(std::make_unique<SketchType>()), tracker_(k) {}
+
+    void insert(const KeyType& key) {
+        tracker_.offer(key, sketch_->insert(key));
+    }
+
+    void insert_batch(const KeyType* keys, size_t n) {
+        sketch_->for_each_hashed(keys, n, [&](size_t i, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            tracker_.offer(keys[i], sketch_->insert_hashed(bucket_idx, fp, left_part));
+        });
+    }
+
+    uint32_t query(const KeyType& key) const {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+        return sketch_->query_hashed(bucket_idx, fp, left_part);
+    }
+
+    // Tracked flows with their current estimates, largest first. Flows the
+    // sketch has since evicted are dropped.
+    std::vector<FlowInfo> top_k() const {
+        std::vector<FlowInfo> flows;
+        flows.reserve(tracker_.entries().size());
+        for (const auto& entry : tracker_.entries()) {
+            uint32_t count = query(entry.key);
+            if (count > 0) {
+                flows.push_back({entry.key, count});
+            }
+        }
+        std::sort(flows.begin(), flows.end());
+        return flows;
+    }
+
+    const SketchType& sketch() const { return *sketch_; }
+
+private:
+    std::unique_ptr<SketchType> sketch_;
+    TopKTracker<KeyType> tracker_;
+};
+
+} // namespace jigsaw
@@ -0,0 +1,187 @@
+#pragma once
+#include <immintrin.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sketch.hpp"
+#include "utils/mapped_file.hpp"
+
+namespace jigsaw {
+
+// Trace files (e.g. the CAIDA .dat captures) are flat arrays of 13-byte
+// records: src_ip(4) src_port(2) dst_ip(4) dst_port(2) protocol(1), all in
+// network byte order. IPv4Flow keeps the same fields, reordered and padded
+// to 16 bytes, so one byte shuffle per record converts between them.
+constexpr size_t TRACE_RECORD_SIZE = 13;
+
+// Decode n packed records into out. Padding bytes are zeroed.
+inline void decode_trace_records(const uint8_t* records, size_t n, IPv4Flow* out) {
+    static_assert(sizeof(IPv4Flow) == 16, "one record decodes into one 16-byte vector");
+    size_t i = 0;
+    // Vector loads read 16 bytes per 13-byte record, so the last record
+    // always takes the scalar path and nothing is read past the input
+#if defined(__AVX2__)
+    const __m256i shuffle256 = _mm256_setr_epi8(
+        0, 1, 2, 3, 6, 7, 8, 9, 4, 5, 10, 11, 12, -1, -1, -1,
+        0, 1, 2, 3, 6, 7, 8, 9, 4, 5, 10, 11, 12, -1, -1, -1);
+    for (; i + 2 < n; i += 2) {
+        const uint8_t* record = records + i * TRACE_RECORD_SIZE;
+        __m256i pair = _mm256_loadu2_m128i(reinterpret_cast<const __m128i*>(record + TRACE_RECORD_SIZE),
+                                           reinterpret_cast<const __m128i*>(record));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_shuffle_epi8(pair, shuffle256));
+    }
+#endif
+#if defined(__SSSE3__)
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 3, 6, 7, 8, 9, 4, 5, 10, 11, 12, -1, -1, -1);
+    for (; i + 1 < n; i++) {
+        __m128i record = _mm_loadu_si128(reinterpret_cast<const __m128i*>(records + i * TRACE_RECORD_SIZE));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi8(record, shuffle));
+    }
+#endif
+    for (; i < n; i++) {
+        const uint8_t* record = records + i * TRACE_RECORD_SIZE;
+        IPv4Flow& flow = out[i];
+        std::memset(&flow, 0, sizeof(flow));
+        std::memcpy(&flow.src_ip, record, 4);
+        std::memcpy(&flow.src_port, record + 4, 2);
+        std::memcpy(&flow.dst_ip, record + 6, 4);
+        std::memcpy(&flow.dst_port, record + 10, 2);
+        flow.protocol = record[12];
+    }
+}
+
+// Sequential reader over one memory-mapped trace file. Records are decoded
+// straight from the page cache into the caller's batch; nothing is
+// allocated per record. A trailing partial record is ignored.
+class TraceReader {
+public:
+    explicit TraceReader(const std::string& path) : file_(path) {
+        file_.advise(MADV_SEQUENTIAL);
+    }
+
+    size_t record_num() const { return file_.size() / TRACE_RECORD_SIZE; }
+    size_t remaining() const { return record_num() - position_; }
+
+    // Decode up to max records into out and return how many were read
+    size_t read(IPv4Flow* out, size_t max) {
+        size_t n = std::min(max, remaining());
+        decode_trace_records(file_.data() + position_ * TRACE_RECORD_SIZE, n, out);
+        position_ += n;
+        return n;
+    }
+
+private:
+    MappedFile file_;
+    size_t position_ = 0;
+};
+
+// Replays trace files through consume(const IPv4Flow* flows, size_t n).
+//
+// A reader thread decodes batches (taking the page faults that pull the
+// trace in from disk) into one of two reused buffers while the calling
+// thread consumes the other, so reading and sketching overlap. Stops after
+// max_records records; returns the number replayed. Errors on the reader
+// thread (e.g. a missing file) are rethrown here.
+template<typename Consume>
+size_t replay_traces(const std::vector<std::string>& paths, Consume&& consume,
+                     size_t batch_size = 1 << 14, size_t max_records = SIZE_MAX) {
+    if (batch_size == 0) {
+        throw std::invalid_argument("batch_size must be positive");
+    }
+
+    std::vector<IPv4Flow> buffers[2] = {std::vector<IPv4Flow>(batch_size), std::vector<IPv4Flow>(batch_size)};
+    size_t counts[2] = {0, 0};
+    bool full[2] = {false, false};
+    bool finished = false;
+    bool stopped = false;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable ready;
+
+    std::thread reader([&] {
+        size_t next = 0;
+        size_t total = 0;
+        try {
+            bool halted = false;
+            for (size_t file = 0; file < paths.size() && total < max_records && !halted; file++) {
+                TraceReader trace(paths[file]);
+                while (trace.remaining() > 0 && total < max_records) {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        ready.wait(lock, [&] { return !full[next] || stopped; });
+                        halted = stopped;
+                    }
+                    if (halted) {
+                        break;
+                    }
+                    size_t n = trace.read(buffers[next].data(), std::min(batch_size, max_records - total));
+                    total += n;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        counts[next] = n;
+                        full[next] = true;
+                    }
+                    ready.notify_all();
+                    next ^= 1;
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        ready.notify_all();
+    });
+
+    size_t replayed = 0;
+    size_t current = 0;
+    try {
+        while (true) {
+            size_t n;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&] { return full[current] || finished; });
+                if (!full[current]) {
+                    break;
+                }
+                n = counts[current];
+            }
+            consume(buffers[current].data(), n);
+            replayed += n;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                full[current] = false;
+            }
+            ready.notify_all();
+            current ^= 1;
+        }
+    } catch (...) {
+        // Stop the reader so it can be joined, then report the consumer's
+        // error
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        ready.notify_all();
+        reader.join();
+        throw;
+    }
+    reader.join();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return replayed;
+}
+
+} // namespace jigsaw
@@ -1,6 +1,13 @@
 #pragma once
 #include <memory>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
 
 namespace jigsaw {
 
@@ -29,11 +36,13 @@ public:
     AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
 
     pointer allocate(size_type n) {
-        if (n > std::numeric_limits<size_type>::max() / sizeof(T)) {
+        if (n > (std::numeric_limits<size_type>::max() - Alignment) / sizeof(T)) {
             throw std::bad_alloc();
         }
-        
-        if (auto ptr = std::aligned_alloc(Alignment, n * sizeof(T))) {
+
+        // aligned_alloc requires the size to be a multiple of the alignment
+        size_type bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+        if (auto ptr = std::aligned_alloc(Alignment, bytes)) {
             return static_cast<T*>(ptr);
         }
         throw std::bad_alloc();
@@ -48,4 +57,99 @@ public:
     bool operator!=(const AlignedAllocator&) const noexcept { return false; }
 };
 
+static constexpr std::size_t HUGE_PAGE_SIZE = std::size_t(2) << 20;
+
+// Zero-initialized, cache-line aligned storage for large sketch arrays.
+// With huge_pages set it first asks for explicit 2 MB pages (MAP_HUGETLB,
+// needs a reserved hugetlbfs pool); without a pool it falls back to a
+// 2 MB-aligned allocation advised for transparent huge pages.
+template<typename T>
+class AlignedBuffer {
+public:
+    AlignedBuffer() = default;
+
+    AlignedBuffer(std::size_t n, bool huge_pages) : size_(n) {
+        if (n == 0) {
+            return;
+        }
+        if (huge_pages) {
+            bytes_ = (n * sizeof(T) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+            void* addr = ::mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (addr != MAP_FAILED) {
+                data_ = static_cast<T*>(addr);
+                mode_ = Mode::HugeTlb;
+                return;
+            }
+#endif
+            data_ = AlignedAllocator<T, HUGE_PAGE_SIZE>().allocate(n);
+            mode_ = Mode::HugeAligned;
+#ifdef MADV_HUGEPAGE
+            ::madvise(data_, bytes_, MADV_HUGEPAGE);
+#endif
+        } else {
+            data_ = AlignedAllocator<T, 64>().allocate(n);
+            mode_ = Mode::Aligned;
+        }
+        std::memset(static_cast<void*>(data_), 0, n * sizeof(T));
+    }
+
+    ~AlignedBuffer() { release(); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+          bytes_(std::exchange(other.bytes_, 0)), mode_(std::exchange(other.mode_, Mode::Aligned)) {}
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            bytes_ = std::exchange(other.bytes_, 0);
+            mode_ = std::exchange(other.mode_, Mode::Aligned);
+        }
+        return *this;
+    }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+    T& operator[](std::size_t i) { return data_[i]; }
+    const T& operator[](std::size_t i) const { return data_[i]; }
+
+    // Whether the buffer is backed by explicit (hugetlbfs) huge pages
+    bool huge_tlb() const { return mode_ == Mode::HugeTlb; }
+
+private:
+    enum class Mode { Aligned, HugeAligned, HugeTlb };
+
+    void release() {
+        if (!data_) {
+            return;
+        }
+        switch (mode_) {
+        case Mode::HugeTlb:
+            ::munmap(data_, bytes_);
+            break;
+        case Mode::HugeAligned:
+            AlignedAllocator<T, HUGE_PAGE_SIZE>().deallocate(data_, size_);
+            break;
+        case Mode::Aligned:
+            AlignedAllocator<T, 64>().deallocate(data_, size_);
+            break;
+        }
+        data_ = nullptr;
+    }
+
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t bytes_ = 0;
+    Mode mode_ = Mode::Aligned;
+};
+
 } // namespace jigsaw 
\ No newline at end of file
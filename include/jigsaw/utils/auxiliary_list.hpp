@@ -0,0 +1,213 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include "../config.hpp"
+
+namespace jigsaw {
+namespace auxiliary {
+
+// Codec for the auxiliary list: each heavy-cell slot holds left_part_bits of
+// left part followed by EXTRA_BITS_NUM of extra counter. Left parts are
+// passed as 64-bit words, at least two.
+//
+// Slots of up to 128 bits are read as one 128-bit window funnel-shifted out
+// of (at most) three consecutive words and written back with masks, so every
+// access is a fixed handful of loads and stores instead of a per-word loop.
+// Reads may touch the word after a slot, so auxiliary lists carry one word of
+// slack at the end (see word_num). Writes only touch words the slot overlaps,
+// which keeps disjoint slot ranges safe to update concurrently. Wider slots
+// (left parts of long keys) are moved a word at a time.
+
+using Window = unsigned __int128;
+
+inline Window low_bits(uint32_t width) {
+    return width >= 128 ? ~Window(0) : (Window(1) << width) - 1;
+}
+
+// width bits starting at bit_idx; the three words read are w0..w2
+inline Window load_window(uint64_t w0, uint64_t w1, uint64_t w2, uint32_t offset, uint32_t width) {
+    Window window = ((Window(w1) << 64) | w0) >> offset;
+    window |= Window(w2) << 1 << (127 - offset);   // nothing when offset == 0
+    return window & low_bits(width);
+}
+
+inline Window load_bits(const uint64_t* words, uint64_t bit_idx, uint32_t width) {
+    const uint64_t* w = words + bit_idx / 64;
+    return load_window(w[0], w[1], width > 64 ? w[2] : 0, bit_idx % 64, width);
+}
+
+inline void store_bits(uint64_t* words, uint64_t bit_idx, uint32_t width, Window value) {
+    uint64_t* w = words + bit_idx / 64;
+    const uint32_t offset = bit_idx % 64;
+    const Window mask = low_bits(width);
+    const Window shifted_mask = mask << offset;
+    const Window shifted_value = (value & mask) << offset;
+
+    w[0] = (w[0] & ~uint64_t(shifted_mask)) | uint64_t(shifted_value);
+    if (offset + width > 64) {
+        w[1] = (w[1] & ~uint64_t(shifted_mask >> 64)) | uint64_t(shifted_value >> 64);
+    }
+    if (offset + width > 128) {
+        const uint64_t top_mask = uint64_t(mask >> 1 >> (127 - offset));
+        const uint64_t top_value = uint64_t((value & mask) >> 1 >> (127 - offset));
+        w[2] = (w[2] & ~top_mask) | top_value;
+    }
+}
+
+// width (<= 64) bits starting at bit_idx, touching only the words they span
+inline uint64_t load_word_bits(const uint64_t* words, uint64_t bit_idx, uint32_t width) {
+    const uint64_t* w = words + bit_idx / 64;
+    const uint32_t offset = bit_idx % 64;
+    uint64_t value = w[0] >> offset;
+    if (offset + width > 64) {
+        value |= w[1] << (64 - offset);
+    }
+    return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+}
+
+// Slot accessors specialized for a compile-time slot width.
+//
+// Packed slots sit back to back. Padded slots fit as many whole slots as
+// possible into each 64-byte line (6 of 81 bits, 4 of 106 bits) and leave
+// the remainder unused, so a slot never straddles a cache line and the
+// window read stays inside it as well.
+template<uint32_t LeftPartBits, bool Padded = false>
+struct SlotCodec {
+    static constexpr uint32_t SLOT_BITS = LeftPartBits + Config::EXTRA_BITS_NUM;
+    static constexpr uint32_t LINE_BITS = 512;
+    static_assert(LeftPartBits > 0, "empty left part");
+    static_assert(!Padded || SLOT_BITS <= LINE_BITS, "padded slots must fit in a cache line");
+
+    static constexpr uint32_t SLOTS_PER_LINE = LINE_BITS / SLOT_BITS;
+
+    // Words a decoded left part fills
+    static constexpr uint32_t LEFT_PART_WORDS = std::max(2u, (LeftPartBits + 63) / 64);
+
+    // Wider than the 128-bit window: accessed a word at a time
+    static constexpr bool WIDE = SLOT_BITS > 128;
+
+    static constexpr uint64_t slot_bit(uint64_t slot_idx) {
+        if constexpr (Padded) {
+            return slot_idx / SLOTS_PER_LINE * LINE_BITS + slot_idx % SLOTS_PER_LINE * SLOT_BITS;
+        } else {
+            return slot_idx * SLOT_BITS;
+        }
+    }
+
+    // Words to allocate for slot_num slots, including the slack word packed
+    // slots need (padded reads never leave their line)
+    static constexpr uint64_t word_num(uint64_t slot_num) {
+        if constexpr (Padded) {
+            return (slot_num + SLOTS_PER_LINE - 1) / SLOTS_PER_LINE * (LINE_BITS / 64);
+        } else {
+            return (slot_num * SLOT_BITS + 63) / 64 + 1;
+        }
+    }
+
+    // Slots per aligned group whose bits start on a 64-bit word boundary
+    static constexpr uint64_t WORD_ALIGNED_SLOTS = Padded ? SLOTS_PER_LINE : 64 / std::gcd(SLOT_BITS, 64u);
+
+    static Window load_slot(const uint64_t* auxiliary_list, uint64_t slot_idx) {
+        const uint64_t bit_idx = slot_bit(slot_idx);
+        const uint64_t* w = auxiliary_list + bit_idx / 64;
+        const uint32_t offset = bit_idx % 64;
+        if constexpr (Padded) {
+            // Words past the slot are masked off anyway; clamp them to the
+            // slot's own line so the read never touches the next one
+            const uint32_t line_word = (bit_idx % LINE_BITS) / 64;
+            const uint64_t w1 = w[std::min<uint32_t>(1, 7 - line_word)];
+            const uint64_t w2 = SLOT_BITS > 64 ? w[std::min<uint32_t>(2, 7 - line_word)] : 0;
+            return load_window(w[0], w1, w2, offset, SLOT_BITS);
+        } else {
+            return load_window(w[0], w[1], SLOT_BITS > 64 ? w[2] : 0, offset, SLOT_BITS);
+        }
+    }
+
+    static uint8_t get_left_part(const uint64_t* auxiliary_list, uint64_t slot_idx, uint64_t* left_part) {
+        if constexpr (WIDE) {
+            const uint64_t bit_idx = slot_bit(slot_idx);
+            for (uint32_t i = 0; i < LEFT_PART_WORDS; i++) {
+                left_part[i] = load_word_bits(auxiliary_list, bit_idx + 64 * i, std::min(64u, LeftPartBits - 64 * i));
+            }
+            return static_cast<uint8_t>(load_word_bits(auxiliary_list, bit_idx + LeftPartBits, Config::EXTRA_BITS_NUM));
+        } else {
+            const Window slot = load_slot(auxiliary_list, slot_idx);
+            const Window value = slot & low_bits(LeftPartBits);
+            left_part[0] = uint64_t(value);
+            left_part[1] = uint64_t(value >> 64);
+            return static_cast<uint8_t>(slot >> LeftPartBits);
+        }
+    }
+
+    static void set_left_part(uint64_t* auxiliary_list, uint64_t slot_idx, const uint64_t* left_part) {
+        if constexpr (WIDE) {
+            const uint64_t bit_idx = slot_bit(slot_idx);
+            for (uint32_t i = 0; i < LEFT_PART_WORDS; i++) {
+                store_bits(auxiliary_list, bit_idx + 64 * i, std::min(64u, LeftPartBits - 64 * i), left_part[i]);
+            }
+        } else {
+            store_bits(auxiliary_list, slot_bit(slot_idx), LeftPartBits, (Window(left_part[1]) << 64) | left_part[0]);
+        }
+    }
+
+    static void set_extra_counter(uint64_t* auxiliary_list, uint64_t slot_idx, uint8_t counter) {
+        store_bits(auxiliary_list, slot_bit(slot_idx) + LeftPartBits, Config::EXTRA_BITS_NUM, counter);
+    }
+
+    // Zero a slot's left part and extra counter in one store
+    static void clear_slot(uint64_t* auxiliary_list, uint64_t slot_idx) {
+        if constexpr (WIDE) {
+            for (uint32_t bit = 0; bit < SLOT_BITS; bit += 64) {
+                store_bits(auxiliary_list, slot_bit(slot_idx) + bit, std::min(64u, SLOT_BITS - bit), 0);
+            }
+        } else {
+            store_bits(auxiliary_list, slot_bit(slot_idx), SLOT_BITS, 0);
+        }
+    }
+};
+
+// Runtime-width accessors over packed slots, for sketches sized at runtime
+
+inline uint64_t word_num(uint32_t left_part_bits, uint64_t slot_num) {
+    return (slot_num * (left_part_bits + Config::EXTRA_BITS_NUM) + 63) / 64 + 1;
+}
+
+// Decode slot slot_idx into left_part and return its extra counter
+inline uint8_t get_left_part(const uint64_t* auxiliary_list, uint32_t left_part_bits, uint64_t slot_idx, uint64_t* left_part) {
+    const uint32_t slot_bits = left_part_bits + Config::EXTRA_BITS_NUM;
+    const Window slot = load_bits(auxiliary_list, slot_idx * slot_bits, slot_bits);
+    const Window value = slot & low_bits(left_part_bits);
+    left_part[0] = uint64_t(value);
+    left_part[1] = uint64_t(value >> 64);
+    return static_cast<uint8_t>(slot >> left_part_bits);
+}
+
+// Store the low left_part_bits of left_part into slot slot_idx, leaving its
+// extra counter untouched
+inline void set_left_part(uint64_t* auxiliary_list, uint32_t left_part_bits, uint64_t slot_idx, const uint64_t* left_part) {
+    store_bits(auxiliary_list, slot_idx * (left_part_bits + Config::EXTRA_BITS_NUM), left_part_bits,
+               (Window(left_part[1]) << 64) | left_part[0]);
+}
+
+inline void set_extra_counter(uint64_t* auxiliary_list, uint32_t left_part_bits, uint64_t slot_idx, uint8_t counter) {
+    store_bits(auxiliary_list, slot_idx * (left_part_bits + Config::EXTRA_BITS_NUM) + left_part_bits,
+               Config::EXTRA_BITS_NUM, counter);
+}
+
+// Whether the low left_part_bits of a and b agree
+inline bool same_left_part(const uint64_t* a, const uint64_t* b, uint32_t left_part_bits) {
+    if (left_part_bits > 128) {
+        for (uint32_t bit = 0; bit < left_part_bits; bit += 64) {
+            const uint64_t diff = a[bit / 64] ^ b[bit / 64];
+            if (left_part_bits - bit < 64 ? diff << (64 - (left_part_bits - bit)) : diff) {
+                return false;
+            }
+        }
+        return true;
+    }
+    const Window diff = ((Window(a[1] ^ b[1]) << 64) | (a[0] ^ b[0])) & low_bits(left_part_bits);
+    return diff == 0;
+}
+
+}} // namespace jigsaw::auxiliary
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+
+namespace jigsaw {
+
+// Division-free mapping of 32-bit key hashes onto bucket indices.
+//
+// Power-of-two bucket counts take the low bits, which is exactly what the
+// previous `hash % BucketNum` produced. Other counts use Lemire's
+// multiply-shift reduction on the high bits of a Fibonacci-scrambled hash:
+// the key hashes are not uniform over 32 bits (IPv4 and string keys yield
+// 26-bit values whose top bits also form the fingerprint), and the scramble
+// keeps the bucket choice independent of the fingerprint.
+template<uint32_t N>
+constexpr uint32_t reduce_range(uint32_t hash) {
+    static_assert(N > 0, "at least one bucket");
+    if constexpr ((N & (N - 1)) == 0) {
+        return hash & (N - 1);
+    } else {
+        return static_cast<uint32_t>((uint64_t(hash * 0x9E3779B1u) * N) >> 32);
+    }
+}
+
+// Exact `a % divisor` for a divisor fixed at runtime, using a precomputed
+// 64-bit reciprocal (Lemire, Kaser and Kurz, "Faster Remainder by Direct
+// Computation") instead of a hardware divide per call
+class FastMod {
+public:
+    explicit FastMod(uint32_t divisor)
+        : divisor_(divisor), reciprocal_(UINT64_MAX / divisor + 1) {}
+
+    uint32_t operator()(uint32_t a) const {
+        uint64_t low_bits = reciprocal_ * a;
+        return static_cast<uint32_t>((static_cast<unsigned __int128>(low_bits) * divisor_) >> 64);
+    }
+
+    uint32_t divisor() const { return divisor_; }
+
+private:
+    uint32_t divisor_;
+    uint64_t reciprocal_;
+};
+
+} // namespace jigsaw
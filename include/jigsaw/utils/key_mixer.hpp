@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace jigsaw {
+
+// Invertible mixing of a Bits-wide key held in little-endian 64-bit words,
+// the last one holding the leftover Bits % 64 bits. Every step is a
+// bijection on its word's width, so unmix() restores the key exactly.
+//
+// A round multiplies each word by an odd constant and folds its high half
+// into its low half; words are independent there, so the loop vectorizes.
+// Each word is then added into the next and the last into the first, so
+// after two rounds every output bit depends on the whole key. That is a
+// couple of multiplies per word, where SPECK spent 34 rounds per block.
+template<uint32_t Bits>
+struct KeyMixer {
+    static_assert(Bits > 0, "empty key");
+
+    static constexpr uint32_t WORDS = (Bits + 63) / 64;
+    static constexpr uint32_t ROUNDS = 2;
+
+    static constexpr uint32_t width(uint32_t i) {
+        return i + 1 < WORDS ? 64 : Bits - 64 * (WORDS - 1);
+    }
+
+    static constexpr uint64_t mask(uint32_t i) {
+        return width(i) == 64 ? ~uint64_t(0) : (uint64_t(1) << width(i)) - 1;
+    }
+
+    static void mix(uint64_t* w) {
+        for (uint32_t r = 0; r < ROUNDS; r++) {
+            for (uint32_t i = 0; i < WORDS; i++) {
+                uint64_t x = (w[i] * MUL) & mask(i);
+                w[i] = x ^ (x >> shift(i));
+            }
+            for (uint32_t i = 1; i < WORDS; i++) {
+                w[i] = (w[i] + w[i - 1]) & mask(i);
+            }
+            if constexpr (WORDS > 1) {
+                w[0] = (w[0] + w[WORDS - 1]) & mask(0);
+            }
+        }
+    }
+
+    static void unmix(uint64_t* w) {
+        for (uint32_t r = 0; r < ROUNDS; r++) {
+            if constexpr (WORDS > 1) {
+                w[0] = (w[0] - w[WORDS - 1]) & mask(0);
+            }
+            for (uint32_t i = WORDS - 1; i > 0; i--) {
+                w[i] = (w[i] - w[i - 1]) & mask(i);
+            }
+            for (uint32_t i = 0; i < WORDS; i++) {
+                // A shift of at least half the width undoes in one step
+                uint64_t x = w[i] ^ (w[i] >> shift(i));
+                w[i] = (x * MUL_INV) & mask(i);
+            }
+        }
+    }
+
+private:
+    static constexpr uint64_t MUL = 0x9E3779B97F4A7C15ULL;
+
+    // Newton's iteration; an odd a is its own inverse modulo 8 and each
+    // step doubles the correct low bits
+    static constexpr uint64_t inverse(uint64_t a) {
+        uint64_t x = a;
+        for (int i = 0; i < 5; i++) {
+            x *= 2 - a * x;
+        }
+        return x;
+    }
+
+    static constexpr uint64_t MUL_INV = inverse(MUL);
+    static_assert(MUL * MUL_INV == 1, "multiplier must be invertible modulo 2^64");
+
+    static constexpr uint32_t shift(uint32_t i) { return (width(i) + 1) / 2; }
+};
+
+// Reversible split of a KeyBytes-byte key: after mixing, the low IndexBits
+// select the bucket, the next 16 bits are the fingerprint and the remaining
+// LEFT_PART_BITS form the left part. join() rebuilds the key from the three,
+// so a key decodes exactly when its full left part is stored.
+//
+// split() returns the value to reduce onto the buckets: the mixed key's low
+// 32 bits when the index bits are taken from it, otherwise (IndexBits = 0,
+// e.g. bucket counts that are not a power of two) the 32 bits above the
+// fingerprint, so the bucket choice stays independent of the fingerprint.
+template<size_t KeyBytes, uint32_t IndexBits>
+struct MixedKeySplit {
+    using Mixer = KeyMixer<uint32_t(KeyBytes * 8)>;
+
+    static constexpr uint32_t KEY_BITS = KeyBytes * 8;
+    static constexpr uint32_t LEFT_PART_SHIFT = IndexBits + 16;
+    static constexpr uint32_t LEFT_PART_BITS = KEY_BITS > LEFT_PART_SHIFT ? KEY_BITS - LEFT_PART_SHIFT : 0;
+    static constexpr uint32_t LEFT_PART_WORDS = std::max<uint32_t>(1, (LEFT_PART_BITS + 63) / 64);
+
+    static uint32_t split(const uint8_t* key, uint16_t& fp, uint64_t* left_part) {
+        uint64_t w[Mixer::WORDS + 1];
+        load(key, w);
+        w[Mixer::WORDS] = 0;   // straddling reads past the key see zeros
+        Mixer::mix(w);
+
+        fp = static_cast<uint16_t>(extract(w, IndexBits, 16));
+        for (uint32_t i = 0; i < LEFT_PART_WORDS; i++) {
+            left_part[i] = extract(w, LEFT_PART_SHIFT + 64 * i, 64);
+        }
+        return static_cast<uint32_t>(extract(w, IndexBits > 0 ? 0 : 16, 32));
+    }
+
+    static void join(uint8_t* key, uint32_t index, uint16_t fp, const uint64_t* left_part) {
+        uint64_t w[Mixer::WORDS + 1] = {};
+        deposit(w, 0, IndexBits, index);
+        deposit(w, IndexBits, 16, fp);
+        for (uint32_t i = 0; i < LEFT_PART_WORDS; i++) {
+            deposit(w, LEFT_PART_SHIFT + 64 * i, 64, left_part[i]);
+        }
+        w[Mixer::WORDS - 1] &= Mixer::mask(Mixer::WORDS - 1);
+        Mixer::unmix(w);
+        memcpy(key, w, KeyBytes);
+    }
+
+private:
+    // Whole words load directly; a partial last word is read as the key's
+    // last 8 bytes shifted down, since a narrow copy into a zeroed word
+    // would stall on store forwarding
+    static void load(const uint8_t* key, uint64_t* w) {
+        for (uint32_t i = 0; i < KeyBytes / 8; i++) {
+            memcpy(&w[i], key + 8 * i, 8);
+        }
+        if constexpr (KeyBytes % 8 != 0 && KeyBytes > 8) {
+            uint64_t last;
+            memcpy(&last, key + KeyBytes - 8, 8);
+            w[KeyBytes / 8] = last >> (64 - 8 * (KeyBytes % 8));
+        } else if constexpr (KeyBytes % 8 != 0) {
+            w[0] = 0;
+            memcpy(&w[0], key, KeyBytes);
+        }
+    }
+
+    // width (<= 64) bits from bit pos; bits past the key read as zero
+    static uint64_t extract(const uint64_t* w, uint32_t pos, uint32_t width) {
+        if (pos >= KEY_BITS) {
+            return 0;
+        }
+        const uint32_t offset = pos % 64;
+        uint64_t value = w[pos / 64] >> offset;
+        if (offset > 0) {
+            value |= w[pos / 64 + 1] << (64 - offset);
+        }
+        return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+    }
+
+    // OR width (<= 64) bits of value in at bit pos; bits past the key are
+    // dropped or masked off by the caller
+    static void deposit(uint64_t* w, uint32_t pos, uint32_t width, uint64_t value) {
+        if (width == 0 || pos >= KEY_BITS) {
+            return;
+        }
+        if (width < 64) {
+            value &= (uint64_t(1) << width) - 1;
+        }
+        const uint32_t offset = pos % 64;
+        w[pos / 64] |= value << offset;
+        if (offset > 0 && pos / 64 + 1 < Mixer::WORDS) {
+            w[pos / 64 + 1] |= value >> (64 - offset);
+        }
+    }
+};
+
+} // namespace jigsaw
@@ -0,0 +1,83 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace jigsaw {
+
+// Read-only memory mapping of a whole file (POSIX)
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "fstat " + path);
+        }
+
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), "mmap " + path);
+            }
+            data_ = static_cast<const uint8_t*>(addr);
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) {
+            ::munmap(const_cast<uint8_t*>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            if (data_) {
+                ::munmap(const_cast<uint8_t*>(data_), size_);
+            }
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Access-pattern hint for the whole mapping (MADV_SEQUENTIAL, ...)
+    void advise(int advice) const {
+        if (data_) {
+            ::madvise(const_cast<uint8_t*>(data_), size_, advice);
+        }
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace jigsaw
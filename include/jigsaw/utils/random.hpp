@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+
+namespace jigsaw {
+
+// wyrand (Wang Yi): 8 bytes of state and one 64x64->128 multiply per draw.
+// Default RNG policy for the sketches' probabilistic replacement; any
+// UniformRandomBitGenerator constructible from a 64-bit seed and producing
+// at least 32 random bits (e.g. std::mt19937) can be used instead.
+class WyRand {
+public:
+    using result_type = uint64_t;
+
+    explicit WyRand(uint64_t seed = 0) : state_(seed) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() {
+        state_ += 0xa0761d6478bd642fULL;
+        unsigned __int128 product = static_cast<unsigned __int128>(state_) * (state_ ^ 0xe7037ed1a0b428dbULL);
+        return static_cast<uint64_t>(product >> 64) ^ static_cast<uint64_t>(product);
+    }
+
+private:
+    uint64_t state_;
+};
+
+// True with probability ceil(2^32 / n) / 2^32 ~ 1/n for a uniform 32-bit
+// draw (n >= 1): r * n stays below 2^32 only for the lowest 2^32 / n values
+// of r, so no division is needed
+inline bool one_in(uint32_t random, uint32_t n) {
+    return ((uint64_t(random) * n) >> 32) == 0;
+}
+
+// True with probability ~ min(weight / n, 1): the same draw falls among the
+// lowest weight of its n equal ranges
+inline bool one_in(uint32_t random, uint32_t n, uint32_t weight) {
+    return ((uint64_t(random) * n) >> 32) < weight;
+}
+
+} // namespace jigsaw
@@ -1,6 +1,9 @@
 #pragma once
 #include <immintrin.h>
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <cstring>
 
 namespace jigsaw {
 namespace simd {
@@ -25,4 +28,151 @@ inline uint32_t compare_fingerprints(__m256i fps, uint16_t target) {
     return _mm256_movemask_epi8(cmp);
 }
 
-}} // namespace jigsaw::simd 
\ No newline at end of file
+// Lane masks below carry one bit per element (bit i <=> element i), so
+// callers can combine fingerprint and counter masks directly.
+
+// Bitmask of the N 16-bit values equal to target (N <= 64)
+template<uint32_t N>
+inline uint64_t match_epi16(const uint16_t* values, uint16_t target) {
+    static_assert(N <= 64, "at most 64 lanes per mask");
+    uint64_t mask = 0;
+    uint32_t i = 0;
+#if defined(__AVX512BW__)
+    const __m512i target512 = _mm512_set1_epi16(target);
+    for (; i + 32 <= N; i += 32) {
+        __m512i v = _mm512_loadu_si512(values + i);
+        mask |= static_cast<uint64_t>(_mm512_cmpeq_epi16_mask(v, target512)) << i;
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256i target256 = _mm256_set1_epi16(target);
+    for (; i + 16 <= N; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i cmp = _mm256_cmpeq_epi16(v, target256);
+        // Saturating pack narrows each 16-bit lane to a byte: lanes 0-7 land
+        // in bits 0-7 and lanes 8-15 in bits 16-23 of the byte movemask
+        uint32_t m = _mm256_movemask_epi8(_mm256_packs_epi16(cmp, cmp));
+        mask |= static_cast<uint64_t>((m & 0xFF) | ((m >> 8) & 0xFF00)) << i;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i target128 = _mm_set1_epi16(target);
+    for (; i + 8 <= N; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        __m128i cmp = _mm_cmpeq_epi16(v, target128);
+        mask |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_packs_epi16(cmp, cmp)) & 0xFF) << i;
+    }
+#endif
+    for (; i < N; i++) {
+        mask |= static_cast<uint64_t>(values[i] == target) << i;
+    }
+    return mask;
+}
+
+// Bitmask of the N 32-bit values equal to target (N <= 64)
+template<uint32_t N>
+inline uint64_t match_epi32(const uint32_t* values, uint32_t target) {
+    static_assert(N <= 64, "at most 64 lanes per mask");
+    uint64_t mask = 0;
+    uint32_t i = 0;
+#if defined(__AVX512F__)
+    const __m512i target512 = _mm512_set1_epi32(static_cast<int>(target));
+    for (; i + 16 <= N; i += 16) {
+        __m512i v = _mm512_loadu_si512(values + i);
+        mask |= static_cast<uint64_t>(_mm512_cmpeq_epi32_mask(v, target512)) << i;
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256i target256 = _mm256_set1_epi32(static_cast<int>(target));
+    for (; i + 8 <= N; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i cmp = _mm256_cmpeq_epi32(v, target256);
+        mask |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(cmp))) << i;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i target128 = _mm_set1_epi32(static_cast<int>(target));
+    for (; i + 4 <= N; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        __m128i cmp = _mm_cmpeq_epi32(v, target128);
+        mask |= static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(cmp))) << i;
+    }
+#endif
+    for (; i < N; i++) {
+        mask |= static_cast<uint64_t>(values[i] == target) << i;
+    }
+    return mask;
+}
+
+// Smallest of the N unsigned 32-bit values
+template<uint32_t N>
+inline uint32_t min_epu32(const uint32_t* values) {
+    uint32_t result = UINT32_MAX;
+    uint32_t i = 0;
+#if defined(__SSE4_1__)
+    if constexpr (N >= 4) {
+        __m128i vmin = _mm_set1_epi32(-1);
+#if defined(__AVX2__)
+        if (i + 8 <= N) {
+            __m256i vmin256 = _mm256_set1_epi32(-1);
+            for (; i + 8 <= N; i += 8) {
+                vmin256 = _mm256_min_epu32(vmin256,
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)));
+            }
+            vmin = _mm_min_epu32(_mm256_castsi256_si128(vmin256),
+                                 _mm256_extracti128_si256(vmin256, 1));
+        }
+#endif
+        for (; i + 4 <= N; i += 4) {
+            vmin = _mm_min_epu32(vmin, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+        }
+        vmin = _mm_min_epu32(vmin, _mm_shuffle_epi32(vmin, _MM_SHUFFLE(1, 0, 3, 2)));
+        vmin = _mm_min_epu32(vmin, _mm_shuffle_epi32(vmin, _MM_SHUFFLE(2, 3, 0, 1)));
+        result = std::min(result, static_cast<uint32_t>(_mm_cvtsi128_si32(vmin)));
+    }
+#endif
+    for (; i < N; i++) {
+        result = std::min(result, values[i]);
+    }
+    return result;
+}
+
+// Index of the first smallest of the N unsigned 32-bit values
+template<uint32_t N>
+inline uint32_t min_index_epu32(const uint32_t* values) {
+    uint32_t idx = static_cast<uint32_t>(__builtin_ctzll(match_epi32<N>(values, min_epu32<N>(values))));
+    // The minimum always matches a lane; telling the compiler keeps callers'
+    // array bounds analysis quiet
+    if (idx >= N) __builtin_unreachable();
+    return idx;
+}
+
+// Zero bytes at dst with non-temporal stores, so resetting a large table
+// does not evict the working set from cache. Unaligned head and tail bytes
+// use memset.
+inline void stream_zero(void* dst, size_t bytes) {
+    uint8_t* p = static_cast<uint8_t*>(dst);
+    size_t head = std::min(bytes, size_t((64 - reinterpret_cast<uintptr_t>(p) % 64) % 64));
+    std::memset(p, 0, head);
+    p += head;
+    bytes -= head;
+
+    size_t body = bytes / 64 * 64;
+#if defined(__AVX512F__)
+    const __m512i zero = _mm512_setzero_si512();
+    for (size_t i = 0; i < body; i += 64) {
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(p + i), zero);
+    }
+#else
+    const __m256i zero = _mm256_setzero_si256();
+    for (size_t i = 0; i < body; i += 64) {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(p + i), zero);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(p + i + 32), zero);
+    }
+#endif
+    // Order the streaming stores before whatever publishes the cleared memory
+    _mm_sfence();
+    std::memset(p + body, 0, bytes - body);
+}
+
+}} // namespace jigsaw::simd
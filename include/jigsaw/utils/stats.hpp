@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace jigsaw {
+
+// How often each branch of Sketch's update and lookup paths was taken, to
+// explain a change in ns/insert: a workload drifting from matched cells to
+// replacements, or into the 512-packet left part checks, shows up here
+// before it does in averages.
+//
+// Counting is compiled in only with JIGSAW_ENABLE_STATS defined (CMake
+// option of the same name). Otherwise the recorder is an empty struct, every
+// JIGSAW_STAT is a no-op and stats() returns zeros.
+#ifdef JIGSAW_ENABLE_STATS
+inline constexpr bool STATS_ENABLED = true;
+#else
+inline constexpr bool STATS_ENABLED = false;
+#endif
+
+// Plain snapshot, e.g. for an exporter to scrape and diff
+struct SketchStats {
+    uint64_t inserts = 0;
+    uint64_t queries = 0;
+    uint64_t empty_fills = 0;             // new flow took an empty heavy or light cell
+    uint64_t heavy_matches = 0;
+    uint64_t light_matches = 0;           // including promotions
+    uint64_t promotions = 0;              // light cell swapped into the heavy part
+    uint64_t replacements = 0;            // probabilistic replacement taken on a miss
+    uint64_t replacements_rejected = 0;
+    uint64_t verifications = 0;           // left part checks at 512 packets, then 1 in 512
+    uint64_t extra_increments = 0;        // check agreed
+    uint64_t extra_decrements = 0;        // check disagreed, extra counter still positive
+    uint64_t left_part_rewrites = 0;      // check disagreed with the extra counter at 0
+};
+
+// One event count. The writer bumps it with a relaxed load and store rather
+// than fetch_add, keeping locked instructions off the hot path; concurrent
+// const queries may then drop a count but never race.
+class StatCounter {
+public:
+    void add() const { value_.store(value_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+    void reset() { value_.store(0, std::memory_order_relaxed); }
+
+private:
+    mutable std::atomic<uint64_t> value_{0};
+};
+
+template<bool Enabled = STATS_ENABLED>
+struct StatsRecorder {
+    StatCounter inserts, queries, empty_fills, heavy_matches, light_matches, promotions, replacements,
+        replacements_rejected, verifications, extra_increments, extra_decrements, left_part_rewrites;
+
+    SketchStats snapshot() const {
+        SketchStats stats;
+        stats.inserts = inserts.get();
+        stats.queries = queries.get();
+        stats.empty_fills = empty_fills.get();
+        stats.heavy_matches = heavy_matches.get();
+        stats.light_matches = light_matches.get();
+        stats.promotions = promotions.get();
+        stats.replacements = replacements.get();
+        stats.replacements_rejected = replacements_rejected.get();
+        stats.verifications = verifications.get();
+        stats.extra_increments = extra_increments.get();
+        stats.extra_decrements = extra_decrements.get();
+        stats.left_part_rewrites = left_part_rewrites.get();
+        return stats;
+    }
+
+    void reset() {
+        for (StatCounter* counter : {&inserts, &queries, &empty_fills, &heavy_matches, &light_matches, &promotions,
+                                     &replacements, &replacements_rejected, &verifications, &extra_increments,
+                                     &extra_decrements, &left_part_rewrites}) {
+            counter->reset();
+        }
+    }
+};
+
+template<>
+struct StatsRecorder<false> {
+    SketchStats snapshot() const { return {}; }
+    void reset() {}
+};
+
+} // namespace jigsaw
+
+#ifdef JIGSAW_ENABLE_STATS
+#define JIGSAW_STAT(recorder, event) (recorder).event.add()
+#else
+#define JIGSAW_STAT(recorder, event) ((void)0)
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+#include "sketch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <immintrin.h>
+#include <memory>
+#include <vector>
+
+namespace jigsaw {
+
+// Sketch with one writer and any number of concurrent readers.
+//
+// Every bucket has a sequence counter that the writer makes odd while it
+// updates the bucket (cells and left parts) and even again afterwards.
+// Readers run the normal lookup, then re-check the counter and retry if the
+// bucket was being written or changed underneath them, as with a kernel
+// seqcount. The writer never waits for readers and pays two plain stores
+// per insert; readers never copy or pause the sketch.
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout>
+class VersionedSketch {
+public:
+    using SketchType = Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout>;
+    using FlowInfo = typename SketchType::FlowInfo;
+
+    VersionedSketch()
+        : sketch_(std::make_unique<SketchType>()),
+          versions_(new std::atomic<uint32_t>[BucketNum]) {
+        for (uint32_t i = 0; i < BucketNum; i++) {
+            versions_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Writer side: a single thread at a time
+
+    void insert(const KeyType& key) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+        write(bucket_idx, fp, left_part);
+    }
+
+    void insert_batch(const KeyType* keys, size_t n) {
+        sketch_->for_each_hashed(keys, n, [this](size_t, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            write(bucket_idx, fp, left_part);
+        });
+    }
+
+    // Reader side: any thread, concurrently with the writer
+
+    uint32_t query(const KeyType& key) const {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+
+        for (;;) {
+            uint32_t version = begin_read(bucket_idx);
+            uint32_t count = sketch_->query_hashed(bucket_idx, fp, left_part);
+            if (end_read(bucket_idx, version)) {
+                return count;
+            }
+        }
+    }
+
+    // Heavy flows, largest first. Each bucket is read consistently; the
+    // dump as a whole is not a single point-in-time snapshot.
+    std::vector<FlowInfo> get_heavy_flows() const {
+        std::vector<FlowInfo> flows;
+        for (uint32_t bucket_idx = 0; bucket_idx < BucketNum; bucket_idx++) {
+            size_t mark = flows.size();
+            for (;;) {
+                uint32_t version = begin_read(bucket_idx);
+                sketch_->bucket_heavy_flows(bucket_idx, flows);
+                if (end_read(bucket_idx, version)) {
+                    break;
+                }
+                flows.resize(mark);
+            }
+        }
+        std::sort(flows.begin(), flows.end());
+        return flows;
+    }
+
+private:
+    void write(uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+        std::atomic<uint32_t>& version = versions_[bucket_idx];
+        uint32_t current = version.load(std::memory_order_relaxed);
+        version.store(current + 1, std::memory_order_relaxed);
+        // Bucket writes must not become visible before the odd version
+        std::atomic_thread_fence(std::memory_order_release);
+        sketch_->insert_hashed(bucket_idx, fp, left_part);
+        version.store(current + 2, std::memory_order_release);
+    }
+
+    uint32_t begin_read(uint32_t bucket_idx) const {
+        for (;;) {
+            uint32_t version = versions_[bucket_idx].load(std::memory_order_acquire);
+            if (!(version & 1)) {
+                return version;
+            }
+            _mm_pause();
+        }
+    }
+
+    bool end_read(uint32_t bucket_idx, uint32_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return versions_[bucket_idx].load(std::memory_order_relaxed) == version;
+    }
+
+    std::unique_ptr<SketchType> sketch_;
+    std::unique_ptr<std::atomic<uint32_t>[]> versions_;
+};
+
+} // namespace jigsaw
@@ -0,0 +1,218 @@
+#pragma once
+#include "sketch.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace jigsaw {
+
+// Sliding-window counts over a ring of window_num sub-sketches, one per
+// epoch (e.g. one second each for "top talkers in the last 10 seconds").
+// Inserts go to the newest sub-sketch; rotate() retires the oldest one and
+// reuses it for the new epoch.
+//
+// Retiring never sweeps a sub-sketch: each keeps a generation number, and
+// every bucket remembers the generation that last wrote it. Buckets from an
+// older generation read as empty and are cleared when next written, so a
+// rotation costs O(1) on the packet path.
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout>
+class WindowedSketch {
+public:
+    using SketchType = Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout>;
+    using FlowInfo = typename SketchType::FlowInfo;
+
+    explicit WindowedSketch(size_t window_num) {
+        if (window_num == 0) {
+            throw std::invalid_argument("WindowedSketch needs at least one window");
+        }
+        windows_.reserve(window_num);
+        for (size_t i = 0; i < window_num; i++) {
+            windows_.push_back(std::make_unique<Window>());
+        }
+    }
+
+    size_t window_num() const { return windows_.size(); }
+    uint64_t epoch() const { return epoch_; }
+
+    // Start a new epoch, dropping the oldest window's counts
+    void rotate() {
+        epoch_++;
+        current_ = (current_ + 1) % windows_.size();
+        windows_[current_]->generation++;
+    }
+
+    // Rotate up to the given epoch; a gap of window_num or more epochs
+    // leaves every window empty
+    void advance_to(uint64_t epoch) {
+        uint64_t steps = epoch > epoch_ ? epoch - epoch_ : 0;
+        for (uint64_t i = 0; i < std::min<uint64_t>(steps, windows_.size()); i++) {
+            rotate();
+        }
+        epoch_ = std::max(epoch_, epoch);
+    }
+
+    void insert(const KeyType& key) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+        Window& window = *windows_[current_];
+        claim(window, bucket_idx);
+        window.sketch.insert_hashed(bucket_idx, fp, left_part);
+    }
+
+    void insert_batch(const KeyType* keys, size_t n) {
+        Window& window = *windows_[current_];
+        window.sketch.for_each_hashed(keys, n,
+                                      [&](size_t, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            claim(window, bucket_idx);
+            window.sketch.insert_hashed(bucket_idx, fp, left_part);
+        });
+    }
+
+    // Estimated count over the whole window
+    uint32_t query(const KeyType& key) const {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+
+        uint64_t count = 0;
+        for (const auto& window : windows_) {
+            if (window->bucket_generation[bucket_idx] == window->generation) {
+                count += window->sketch.query_hashed(bucket_idx, fp, left_part);
+            }
+        }
+        return static_cast<uint32_t>(std::min<uint64_t>(count, UINT32_MAX));
+    }
+
+    // Heavy flows of the whole window, largest first. A flow that is heavy
+    // in several epochs is reported once with its counts summed.
+    std::vector<FlowInfo> get_heavy_flows() const {
+        std::vector<FlowInfo> flows;
+        for (const auto& window : windows_) {
+            const Window& w = *window;
+            auto live = w.sketch.get_heavy_flows([&w](uint32_t bucket_idx, uint32_t count) {
+                return w.bucket_generation[bucket_idx] == w.generation ? count : 0;
+            });
+            flows.insert(flows.end(), live.begin(), live.end());
+        }
+
+        auto key_less = [](const FlowInfo& a, const FlowInfo& b) {
+            return memcmp(&a.key, &b.key, KeyType::SIZE) < 0;
+        };
+        std::sort(flows.begin(), flows.end(), key_less);
+        size_t out = 0;
+        for (size_t i = 0; i < flows.size(); i++) {
+            if (out > 0 && memcmp(&flows[out - 1].key, &flows[i].key, KeyType::SIZE) == 0) {
+                flows[out - 1].count = static_cast<uint32_t>(
+                    std::min<uint64_t>(uint64_t(flows[out - 1].count) + flows[i].count, UINT32_MAX));
+            } else {
+                flows[out++] = flows[i];
+            }
+        }
+        flows.resize(out);
+        std::sort(flows.begin(), flows.end());
+        return flows;
+    }
+
+private:
+    struct Window {
+        SketchType sketch;
+        uint32_t generation = 0;
+        std::vector<uint32_t> bucket_generation = std::vector<uint32_t>(BucketNum, 0);
+    };
+
+    // Make a bucket current before writing to it
+    static void claim(Window& window, uint32_t bucket_idx) {
+        if (window.bucket_generation[bucket_idx] != window.generation) {
+            window.sketch.clear_bucket(bucket_idx);
+            window.bucket_generation[bucket_idx] = window.generation;
+        }
+    }
+
+    std::vector<std::unique_ptr<Window>> windows_;
+    size_t current_ = 0;
+    uint64_t epoch_ = 0;
+};
+
+// Exponentially decayed counts: every advance() halves all counters, so a
+// flow's count weighs recent packets more (half-life of one epoch).
+//
+// Decay is applied lazily: each bucket remembers the epoch it was last
+// brought up to date in, and catches up (one shift) the next time it is
+// written. Reads scale by the pending decay without writing, so advancing
+// an epoch never sweeps the sketch.
+template<typename KeyType, uint32_t BucketNum, uint32_t LeftPartBits, uint32_t CellNumH, uint32_t CellNumL,
+         typename Layout = AoSLayout>
+class DecayedSketch {
+public:
+    using SketchType = Sketch<KeyType, BucketNum, LeftPartBits, CellNumH, CellNumL, Layout>;
+    using FlowInfo = typename SketchType::FlowInfo;
+
+    DecayedSketch() : sketch_(std::make_unique<SketchType>()), bucket_epoch_(BucketNum, 0) {}
+
+    uint64_t epoch() const { return epoch_; }
+
+    void advance() {
+        epoch_++;
+    }
+
+    void advance_to(uint64_t epoch) {
+        epoch_ = std::max(epoch_, epoch);
+    }
+
+    void insert(const KeyType& key) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+        catch_up(bucket_idx);
+        sketch_->insert_hashed(bucket_idx, fp, left_part);
+    }
+
+    void insert_batch(const KeyType* keys, size_t n) {
+        sketch_->for_each_hashed(keys, n, [this](size_t, uint32_t bucket_idx, uint16_t fp, const uint64_t* left_part) {
+            catch_up(bucket_idx);
+            sketch_->insert_hashed(bucket_idx, fp, left_part);
+        });
+    }
+
+    uint32_t query(const KeyType& key) const {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[SketchType::LEFT_PART_WORDS];
+        SketchType::divide_key(key, bucket_idx, fp, left_part);
+        return decayed(bucket_idx, sketch_->query_hashed(bucket_idx, fp, left_part));
+    }
+
+    // Heavy flows with their decayed counts, largest first
+    std::vector<FlowInfo> get_heavy_flows() const {
+        return sketch_->get_heavy_flows([this](uint32_t bucket_idx, uint32_t count) {
+            return decayed(bucket_idx, count);
+        });
+    }
+
+private:
+    uint32_t decayed(uint32_t bucket_idx, uint32_t count) const {
+        uint64_t shift = epoch_ - bucket_epoch_[bucket_idx];
+        return shift >= 32 ? 0 : count >> shift;
+    }
+
+    void catch_up(uint32_t bucket_idx) {
+        uint64_t shift = epoch_ - bucket_epoch_[bucket_idx];
+        if (shift > 0) {
+            sketch_->decay_bucket(bucket_idx, static_cast<uint32_t>(std::min<uint64_t>(shift, 32)));
+            bucket_epoch_[bucket_idx] = epoch_;
+        }
+    }
+
+    std::unique_ptr<SketchType> sketch_;
+    std::vector<uint64_t> bucket_epoch_;
+    uint64_t epoch_ = 0;
+};
+
+} // namespace jigsaw
@@ -1,5 +1,26 @@
 #include <gtest/gtest.h>
 #include <jigsaw/sketch.hpp>
+#include <jigsaw/sharded_sketch.hpp>
+#include <jigsaw/concurrent_sketch.hpp>
+#include <jigsaw/dynamic_sketch.hpp>
+#include <jigsaw/trace_reader.hpp>
+#include <jigsaw/tokenizer.hpp>
+#include <jigsaw/windowed_sketch.hpp>
+#include <jigsaw/top_k.hpp>
+#include <jigsaw/versioned_sketch.hpp>
+#include <jigsaw/epoch_sketch.hpp>
+#include <jigsaw/interned_sketch.hpp>
+#include <jigsaw/sketch_types.hpp>
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <random>
+#include <vector>
 
 
 class SketchIPv4Test : public ::testing::Test {
@@ -42,6 +63,89 @@ TEST_F(SketchIPv4Test, QueryAfterInsertion) {
     EXPECT_GT(count, 0);
 }
 
+// Past the 512-packet left-part checks the extra counter grows; it is a
+// confidence in the stored left part and must not scale the count
+TEST_F(SketchIPv4Test, QueryIsExactPastVerification) {
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = 0x12345678;
+    flow.protocol = 6;
+
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, BUCKET_NUM, LEFT_PART_BITS, CELL_NUM_H, CELL_NUM_L>>();
+    jigsaw::DynamicSketch<jigsaw::IPv4Flow> dynamic({BUCKET_NUM, LEFT_PART_BITS, CELL_NUM_H, CELL_NUM_L, false});
+    auto concurrent = std::make_unique<jigsaw::ConcurrentSketch<jigsaw::IPv4Flow, BUCKET_NUM, LEFT_PART_BITS, CELL_NUM_H, CELL_NUM_L>>();
+    for (int i = 0; i < 5000; i++) {
+        sketch->insert(flow);
+        dynamic.insert(flow);
+        concurrent->insert(flow);
+    }
+
+    EXPECT_EQ(sketch->query(flow), 5000u);
+    EXPECT_EQ(dynamic.query(flow), 5000u);
+    EXPECT_EQ(concurrent->query(flow), 5000u);
+}
+
+TEST_F(SketchIPv4Test, BatchMatchesSingleInsertion) {
+    auto single = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, BUCKET_NUM, LEFT_PART_BITS, CELL_NUM_H, CELL_NUM_L>>();
+    std::vector<jigsaw::IPv4Flow> flows;
+    for (uint32_t i = 0; i < 5000; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = 0x0A000000 + (i % 100);
+        flow.dst_ip = 0x0B000000 + (i % 100);
+        flow.src_port = 1000;
+        flow.dst_port = 443;
+        flow.protocol = 6;  // TCP
+        flows.push_back(flow);
+        single->insert(flow);
+    }
+
+    sketch.insert_batch(flows.data(), flows.size());
+
+    std::vector<uint32_t> counts(flows.size());
+    sketch.query_batch(flows.data(), flows.size(), counts.data());
+    for (size_t i = 0; i < flows.size(); i++) {
+        EXPECT_EQ(counts[i], single->query(flows[i]));
+    }
+}
+
+// The batch split must agree with divide_key on every key
+template<uint32_t BucketNum, uint32_t LeftPartBits>
+void check_divide_keys(const std::vector<jigsaw::IPv4Flow>& flows) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, BucketNum, LeftPartBits, 4, 4>;
+    constexpr size_t WORDS = TestSketch::LEFT_PART_WORDS;
+    std::vector<uint32_t> bucket_idx(flows.size());
+    std::vector<uint16_t> fp(flows.size());
+    std::vector<std::array<uint64_t, WORDS>> left_part(flows.size());
+    TestSketch::divide_keys(flows.data(), flows.size(), bucket_idx.data(), fp.data(),
+                            reinterpret_cast<uint64_t (*)[WORDS]>(left_part.data()));
+
+    for (size_t i = 0; i < flows.size(); i++) {
+        uint32_t expected_idx;
+        uint16_t expected_fp;
+        uint64_t expected_part[WORDS] = {};
+        jigsaw::KeyHasher<jigsaw::IPv4Flow, BucketNum>::divide_key(flows[i], expected_idx, expected_fp, expected_part);
+        ASSERT_EQ(bucket_idx[i], expected_idx);
+        ASSERT_EQ(fp[i], expected_fp);
+        for (size_t w = 0; w < WORDS; w++) {
+            ASSERT_EQ(left_part[i][w], expected_part[w]);
+        }
+    }
+}
+
+TEST_F(SketchIPv4Test, BatchSplitMatchesScalar) {
+    std::mt19937 rng(17);
+    std::vector<jigsaw::IPv4Flow> flows(1007);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng();
+        flow.dst_ip = rng();
+        flow.src_port = static_cast<uint16_t>(rng());
+        flow.dst_port = static_cast<uint16_t>(rng());
+        flow.protocol = static_cast<uint8_t>(rng());
+    }
+    check_divide_keys<1024, 79>(flows);
+    check_divide_keys<1000, 104>(flows);
+    check_divide_keys<4096, 150>(flows);
+}
 
 class SketchIPv6Test : public ::testing::Test {
 protected:
@@ -97,6 +201,127 @@ TEST_F(SketchIPv6Test, QueryAfterInsertion) {
 }
 
 
+// Every key decodes back to itself from its bucket, fingerprint and left part
+template<typename KeyType, uint32_t BucketNum>
+void check_key_round_trip(const std::vector<KeyType>& keys) {
+    using Hasher = jigsaw::KeyHasher<KeyType, BucketNum>;
+    for (const auto& key : keys) {
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[Hasher::LEFT_PART_WORDS] = {};
+        Hasher::divide_key(key, bucket_idx, fp, left_part);
+        ASSERT_LT(bucket_idx, BucketNum);
+
+        KeyType decoded{};
+        Hasher::combine_key(decoded, bucket_idx, fp, left_part);
+        ASSERT_EQ(memcmp(&decoded, &key, KeyType::SIZE), 0);
+    }
+}
+
+template<typename KeyType>
+std::vector<KeyType> random_keys(size_t n, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<KeyType> keys(n);
+    for (size_t i = 0; i < n; i++) {
+        uint8_t bytes[KeyType::SIZE];
+        for (auto& byte : bytes) {
+            // Mostly-zero keys too, like real address prefixes
+            byte = i % 2 ? static_cast<uint8_t>(rng()) : (rng() % 8 == 0 ? static_cast<uint8_t>(rng()) : 0);
+        }
+        keys[i] = KeyType{};
+        memcpy(static_cast<void*>(&keys[i]), bytes, KeyType::SIZE);
+    }
+    return keys;
+}
+
+TEST(KeyMixerTest, UnmixInvertsMix) {
+    auto check = [](auto mixer, size_t words) {
+        using Mixer = decltype(mixer);
+        std::mt19937_64 rng(Mixer::WORDS);
+        for (int round = 0; round < 1000; round++) {
+            uint64_t key[8] = {}, mixed[8];
+            for (size_t i = 0; i < words; i++) {
+                key[i] = rng() & Mixer::mask(i);
+            }
+            memcpy(mixed, key, sizeof(key));
+            Mixer::mix(mixed);
+            for (size_t i = 0; i < words; i++) {
+                ASSERT_EQ(mixed[i] & ~Mixer::mask(i), 0u);
+            }
+            Mixer::unmix(mixed);
+            ASSERT_EQ(memcmp(mixed, key, sizeof(key)), 0);
+        }
+    };
+    check(jigsaw::KeyMixer<1>{}, 1);
+    check(jigsaw::KeyMixer<40>{}, 1);
+    check(jigsaw::KeyMixer<64>{}, 1);
+    check(jigsaw::KeyMixer<104>{}, 2);
+    check(jigsaw::KeyMixer<296>{}, 5);
+}
+
+TEST(KeyMixerTest, LongKeysRoundTripThroughTheSplit) {
+    auto ipv6 = random_keys<jigsaw::IPv6Flow>(5000, 1);
+    check_key_round_trip<jigsaw::IPv6Flow, 1024>(ipv6);
+    check_key_round_trip<jigsaw::IPv6Flow, 1000>(ipv6);
+    check_key_round_trip<jigsaw::IPv6Flow, 1>(ipv6);
+    check_key_round_trip<jigsaw::IPv6Flow, 1u << 20>(ipv6);
+
+    check_key_round_trip<jigsaw::GenericKey<1>, 64>(random_keys<jigsaw::GenericKey<1>>(256, 2));
+    check_key_round_trip<jigsaw::GenericKey<7>, 1024>(random_keys<jigsaw::GenericKey<7>>(5000, 3));
+    check_key_round_trip<jigsaw::GenericKey<16>, 4096>(random_keys<jigsaw::GenericKey<16>>(5000, 4));
+    check_key_round_trip<jigsaw::GenericKey<20>, 1000>(random_keys<jigsaw::GenericKey<20>>(5000, 5));
+    check_key_round_trip<jigsaw::GenericKey<64>, 1024>(random_keys<jigsaw::GenericKey<64>>(5000, 6));
+
+    // Flows that differ in one field still spread over the buckets
+    std::vector<uint32_t> hits(1024, 0);
+    for (uint32_t i = 0; i < 102400; i++) {
+        jigsaw::IPv6Flow flow{};
+        flow.src_ip[0] = 0x20010db8;
+        flow.src_port = static_cast<uint16_t>(i);
+        flow.dst_port = static_cast<uint16_t>(i >> 16);
+        uint32_t bucket_idx;
+        uint16_t fp;
+        uint64_t left_part[jigsaw::KeyHasher<jigsaw::IPv6Flow, 1024>::LEFT_PART_WORDS];
+        jigsaw::KeyHasher<jigsaw::IPv6Flow, 1024>::divide_key(flow, bucket_idx, fp, left_part);
+        hits[bucket_idx]++;
+    }
+    EXPECT_GT(*std::min_element(hits.begin(), hits.end()), 50u);
+    EXPECT_LT(*std::max_element(hits.begin(), hits.end()), 150u);
+}
+
+TEST(KeyMixerTest, SketchReportsExactLongKeys) {
+    constexpr uint32_t IPV6_BITS = jigsaw::KeyHasher<jigsaw::IPv6Flow, 256>::LEFT_PART_BITS;
+    using IPv6Sketch = jigsaw::Sketch<jigsaw::IPv6Flow, 256, IPV6_BITS, 8, 8>;
+    using PaddedIPv6Sketch = jigsaw::Sketch<jigsaw::IPv6Flow, 256, IPV6_BITS, 8, 8, jigsaw::PaddedSoALayout>;
+    using ColocatedIPv6Sketch = jigsaw::Sketch<jigsaw::IPv6Flow, 256, IPV6_BITS, 8, 8, jigsaw::ColocatedLayout>;
+    using GenericSketch = jigsaw::Sketch<jigsaw::GenericKey<20>, 1000, 144, 8, 8, jigsaw::SoALayout>;
+    static_assert(IPv6Sketch::EXACT_KEYS && GenericSketch::EXACT_KEYS);
+
+    auto check = [](auto sketch, auto keys) {
+        using KeyType = typename decltype(keys)::value_type;
+        for (size_t i = 0; i < keys.size(); i++) {
+            reinterpret_cast<uint8_t*>(&keys[i])[KeyType::SIZE - 1] = static_cast<uint8_t>(i);   // distinct
+        }
+        // Flow i is inserted i + 1 times, so every count is distinct
+        for (size_t i = 0; i < keys.size(); i++) {
+            for (size_t c = 0; c <= i; c++) {
+                sketch->insert(keys[i]);
+            }
+        }
+        auto flows = sketch->get_heavy_flows();
+        ASSERT_EQ(flows.size(), keys.size());
+        for (size_t i = 0; i < flows.size(); i++) {
+            const auto& key = keys[keys.size() - 1 - i];
+            EXPECT_EQ(flows[i].count, keys.size() - i);
+            EXPECT_EQ(memcmp(&flows[i].key, &key, KeyType::SIZE), 0);
+        }
+    };
+    check(std::make_unique<IPv6Sketch>(), random_keys<jigsaw::IPv6Flow>(100, 7));
+    check(std::make_unique<PaddedIPv6Sketch>(), random_keys<jigsaw::IPv6Flow>(100, 7));
+    check(std::make_unique<ColocatedIPv6Sketch>(), random_keys<jigsaw::IPv6Flow>(100, 7));
+    check(std::make_unique<GenericSketch>(), random_keys<jigsaw::GenericKey<20>>(100, 8));
+}
+
 class SketchCompactStringTest : public ::testing::Test {
 protected:
     static constexpr uint32_t BUCKET_NUM = 1024;
@@ -124,3 +349,1153 @@ TEST_F(SketchCompactStringTest, QueryAfterInsertion) {
     uint32_t count = sketch.query(key);
     EXPECT_GT(count, 0);
 }
+
+TEST(StringKeyTest, KeysRoundTripThroughTheSplit) {
+    check_key_round_trip<jigsaw::CompactStringKey, 1024>(random_keys<jigsaw::CompactStringKey>(5000, 9));
+    check_key_round_trip<jigsaw::StringKey<16>, 1024>(random_keys<jigsaw::StringKey<16>>(5000, 10));
+    check_key_round_trip<jigsaw::StringKey<32, 6>, 1000>(random_keys<jigsaw::StringKey<32, 6>>(5000, 11));
+    check_key_round_trip<jigsaw::StringKey<64>, 4096>(random_keys<jigsaw::StringKey<64>>(5000, 12));
+}
+
+TEST(StringKeyTest, EncodesIdentifiers) {
+    const std::string url = "https://Example.com/v1/items?id=42&sort=-date";
+    EXPECT_EQ(jigsaw::StringKey<64>(url).to_string(), url);
+    EXPECT_EQ((jigsaw::StringKey<64, 6>(url).to_string()), "https://example.com/v1/items?id=42&sort=-date");
+    EXPECT_EQ(jigsaw::StringKey<16>(url).to_string(), url.substr(0, 16));
+
+    // Bytes outside the 6-bit alphabet decode as OTHER_CHAR
+    EXPECT_EQ((jigsaw::StringKey<8, 6>("a\tb{").to_string()),
+              std::string("a") + jigsaw::SixBitAlphabet::OTHER_CHAR + "b" + jigsaw::SixBitAlphabet::OTHER_CHAR);
+
+    // Digits and punctuation no longer collide, and a truncated string
+    // differs from its own prefix
+    auto same = [](const auto& a, const auto& b) { return memcmp(&a, &b, sizeof(a)) == 0; };
+    EXPECT_FALSE(same(jigsaw::StringKey<16, 6>("host-1.lan"), jigsaw::StringKey<16, 6>("host-2.lan")));
+    EXPECT_FALSE(same(jigsaw::StringKey<16, 6>("a.b"), jigsaw::StringKey<16, 6>("a/b")));
+    EXPECT_FALSE(same(jigsaw::StringKey<16>(url), jigsaw::StringKey<16>(url.substr(0, 16))));
+    EXPECT_TRUE(same(jigsaw::StringKey<16, 6>("Host-1.LAN"), jigsaw::StringKey<16, 6>("host-1.lan")));
+}
+
+TEST(StringKeyTest, SketchReportsExactStrings) {
+    using Key = jigsaw::StringKey<32, 6>;
+    using HostSketch = jigsaw::Sketch<Key, 1024, jigsaw::KeyHasher<Key, 1024>::LEFT_PART_BITS, 8, 8>;
+    static_assert(HostSketch::EXACT_KEYS);
+    auto sketch = std::make_unique<HostSketch>(3);
+
+    std::vector<std::string> hosts;
+    for (int i = 0; i < 200; i++) {
+        hosts.push_back("api-" + std::to_string(i) + ".eu-west-1.example.com");
+    }
+    for (size_t i = 0; i < hosts.size(); i++) {
+        for (size_t j = 0; j <= i % 20; j++) {
+            sketch->insert(Key(hosts[i]));
+        }
+    }
+
+    auto flows = sketch->get_heavy_flows();
+    ASSERT_EQ(flows.size(), hosts.size());
+    for (const auto& flow : flows) {
+        std::string host = flow.key.to_string();
+        auto it = std::find(hosts.begin(), hosts.end(), host);
+        ASSERT_NE(it, hosts.end()) << host;
+        EXPECT_EQ(flow.count, (it - hosts.begin()) % 20 + 1);
+    }
+}
+
+TEST(InternedStringSketchTest, ReportsLongStringsOfHeavyFlows) {
+    jigsaw::InternedStringSketch<256, 4, 4> sketch(5);
+
+    // Long log templates sharing a 300-byte prefix, among one-off lines
+    const std::string prefix(300, 'x');
+    std::vector<std::string> heavy;
+    for (int i = 0; i < 20; i++) {
+        heavy.push_back(prefix + " template " + std::to_string(i));
+    }
+    for (int round = 0; round < 100; round++) {
+        for (const auto& line : heavy) {
+            sketch.insert(line);
+        }
+        std::vector<std::string> noise;
+        for (int i = 0; i < 50; i++) {
+            noise.push_back(prefix + " noise " + std::to_string(round * 50 + i));
+        }
+        std::vector<std::string_view> views(noise.begin(), noise.end());
+        sketch.insert_batch(views.data(), views.size());
+    }
+
+    EXPECT_LE(sketch.dictionary_size(), 2u * 256 * 4);
+    auto flows = sketch.get_heavy_flows();
+    ASSERT_GE(flows.size(), heavy.size());
+    for (size_t i = 0; i < heavy.size(); i++) {
+        EXPECT_TRUE(std::find(heavy.begin(), heavy.end(), flows[i].key) != heavy.end()) << flows[i].key;
+        EXPECT_EQ(flows[i].count, 100u);
+        EXPECT_EQ(sketch.query(flows[i].key), 100u);
+    }
+}
+
+template<typename Layout>
+class BucketLayoutTest : public ::testing::Test {};
+
+using BucketLayouts = ::testing::Types<jigsaw::AoSLayout, jigsaw::SoALayout, jigsaw::PaddedSoALayout,
+                                       jigsaw::ColocatedLayout, jigsaw::PackedLayout<>, jigsaw::PackedLayout<14, 12>>;
+TYPED_TEST_SUITE(BucketLayoutTest, BucketLayouts);
+
+TYPED_TEST(BucketLayoutTest, ProbeMatchesScalarScan) {
+    constexpr uint32_t H = 16;
+    constexpr uint32_t L = 8;
+    typename TypeParam::template Bucket<H, L> bucket;
+    std::mt19937 rng(7);
+
+    for (int round = 0; round < 1000; round++) {
+        for (uint32_t i = 0; i < H + L; i++) {
+            bucket.set(i, static_cast<uint16_t>(rng() % 8), rng() % 4 == 0 ? 0 : rng() % 16);
+        }
+        uint16_t fp = static_cast<uint16_t>(rng() % 8);
+
+        uint32_t expected_find = H;
+        uint64_t expected_match = 0;
+        uint32_t expected_smallest = 0;
+        for (uint32_t i = 0; i < H; i++) {
+            if (expected_find == H && (bucket.count(i) == 0 || bucket.fp(i) == fp)) {
+                expected_find = i;
+            }
+            expected_match |= static_cast<uint64_t>(bucket.fp(i) == fp) << i;
+            if (bucket.count(i) < bucket.count(expected_smallest)) {
+                expected_smallest = i;
+            }
+        }
+
+        EXPECT_EQ((bucket.template find<0, H>(fp)), expected_find);
+        EXPECT_EQ((bucket.template match<0, H>(fp)), expected_match);
+        EXPECT_EQ((bucket.template smallest<0, H>()), expected_smallest);
+    }
+}
+
+TYPED_TEST(BucketLayoutTest, QueryAfterInsertion) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 104, 16, 16, TypeParam>>();
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = 0x12345678;
+    flow.dst_ip = 0x87654321;
+    flow.src_port = 80;
+    flow.dst_port = 443;
+    flow.protocol = 6;  // TCP
+
+    for (int i = 0; i < 100; i++) {
+        sketch->insert(flow);
+    }
+
+    EXPECT_EQ(sketch->query(flow), 100u);
+    auto flows = sketch->get_heavy_flows();
+    ASSERT_EQ(flows.size(), 1u);
+    EXPECT_EQ(flows[0].count, 100u);
+}
+
+TEST(PackedLayoutTest, MatchesAoSWithinCounterWidth) {
+    // Below the counter limit only the cell encoding differs, so equal
+    // seeds must give identical sketches, in less memory
+    using AoSSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 256, 79, 8, 8>;
+    using PackedSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 256, 79, 8, 8, jigsaw::PackedLayout<>>;
+    static_assert(PackedSketch::MEMORY_SIZE < AoSSketch::MEMORY_SIZE);
+    static_assert(jigsaw::SketchMemoryUsage<jigsaw::IPv4Flow, 256, 79, 8, 8, jigsaw::PackedLayout<>>() ==
+                  PackedSketch::MEMORY_SIZE);
+    auto aos = std::make_unique<AoSSketch>(5);
+    auto packed = std::make_unique<PackedSketch>(5);
+
+    std::mt19937 rng(21);
+    std::vector<jigsaw::IPv4Flow> flows(50000);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng() % 5000;
+        flow.dst_ip = rng();
+        flow.protocol = 17;  // UDP
+    }
+    aos->insert_batch(flows.data(), flows.size());
+    packed->insert_batch(flows.data(), flows.size());
+
+    for (size_t i = 0; i < 2000; i++) {
+        EXPECT_EQ(packed->query(flows[i]), aos->query(flows[i]));
+    }
+    auto expected = aos->get_heavy_flows();
+    auto actual = packed->get_heavy_flows();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        EXPECT_EQ(actual[i].count, expected[i].count);
+        EXPECT_EQ(actual[i].key.src_ip, expected[i].key.src_ip);
+    }
+}
+
+TEST(PackedLayoutTest, CountersSaturate) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 64, 104, 4, 4, jigsaw::PackedLayout<10>>>();
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = 0x0A000001;
+    for (int i = 0; i < 3000; i++) {
+        sketch->insert(flow);
+    }
+    EXPECT_EQ(sketch->query(flow), 1023u);
+}
+
+TEST(ColocatedLayoutTest, MatchesSplitAuxiliaryList) {
+    // Only where left parts are stored differs, so equal seeds must give
+    // identical sketches
+    using SplitSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 256, 79, 8, 8, jigsaw::SoALayout>;
+    using ColocatedSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 256, 79, 8, 8, jigsaw::ColocatedLayout>;
+    auto split = std::make_unique<SplitSketch>(3);
+    auto colocated = std::make_unique<ColocatedSketch>(3);
+
+    std::mt19937 rng(13);
+    std::vector<jigsaw::IPv4Flow> flows(50000);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng() % 5000;
+        flow.dst_ip = rng();
+        flow.protocol = 6;  // TCP
+    }
+    split->insert_batch(flows.data(), flows.size());
+    colocated->insert_batch(flows.data(), flows.size());
+
+    for (size_t i = 0; i < 2000; i++) {
+        EXPECT_EQ(colocated->query(flows[i]), split->query(flows[i]));
+    }
+    auto expected = split->get_heavy_flows();
+    auto actual = colocated->get_heavy_flows();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        EXPECT_EQ(actual[i].count, expected[i].count);
+        EXPECT_EQ(actual[i].key.src_ip, expected[i].key.src_ip);
+        EXPECT_EQ(actual[i].key.dst_ip, expected[i].key.dst_ip);
+    }
+
+    std::stringstream stream;
+    colocated->serialize(stream);
+    auto restored = std::make_unique<ColocatedSketch>();
+    restored->deserialize(stream);
+    for (size_t i = 0; i < 2000; i++) {
+        EXPECT_EQ(restored->query(flows[i]), colocated->query(flows[i]));
+    }
+}
+
+TEST(WindowedSketchTest, CountsOnlyLiveEpochs) {
+    jigsaw::WindowedSketch<jigsaw::IPv4Flow, 256, 104, 8, 8> sketch(2);
+    jigsaw::IPv4Flow first{}, second{};
+    first.src_ip = 0x0A000001;
+    second.src_ip = 0x0A000002;
+
+    for (int i = 0; i < 100; i++) sketch.insert(first);
+    sketch.rotate();
+    for (int i = 0; i < 50; i++) sketch.insert(second);
+    for (int i = 0; i < 10; i++) sketch.insert(first);
+
+    EXPECT_EQ(sketch.query(first), 110u);
+    EXPECT_EQ(sketch.query(second), 50u);
+    auto flows = sketch.get_heavy_flows();
+    ASSERT_EQ(flows.size(), 2u);
+    EXPECT_EQ(flows[0].key.src_ip, first.src_ip);
+    EXPECT_EQ(flows[0].count, 110u);
+
+    // The first epoch leaves the window without any sweep
+    sketch.rotate();
+    EXPECT_EQ(sketch.query(first), 10u);
+    EXPECT_EQ(sketch.query(second), 50u);
+    sketch.advance_to(sketch.epoch() + 5);
+    EXPECT_EQ(sketch.query(first), 0u);
+    EXPECT_TRUE(sketch.get_heavy_flows().empty());
+}
+
+TEST(DecayedSketchTest, HalvesCountsPerEpochLazily) {
+    jigsaw::DecayedSketch<jigsaw::IPv4Flow, 256, 104, 8, 8> sketch;
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = 0x0A000001;
+
+    for (int i = 0; i < 64; i++) sketch.insert(flow);
+    sketch.advance();
+    sketch.advance();
+    EXPECT_EQ(sketch.query(flow), 16u);
+
+    sketch.insert(flow);  // brings the bucket up to date first
+    EXPECT_EQ(sketch.query(flow), 17u);
+    auto flows = sketch.get_heavy_flows();
+    ASSERT_EQ(flows.size(), 1u);
+    EXPECT_EQ(flows[0].count, 17u);
+
+    sketch.advance_to(sketch.epoch() + 40);
+    EXPECT_EQ(sketch.query(flow), 0u);
+    EXPECT_TRUE(sketch.get_heavy_flows().empty());
+}
+
+TEST(TopKTest, SelectionAndTrackerAgreeWithFullScan) {
+    jigsaw::TopKSketch<jigsaw::IPv4Flow, 256, 104, 8, 8, jigsaw::SoALayout> tracked(5);
+
+    // 20 heavy flows with distinct sizes among one-off noise
+    std::mt19937 rng(17);
+    std::vector<jigsaw::IPv4Flow> stream;
+    for (uint32_t i = 0; i < 20; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = 0x0A000000 + i;
+        flow.protocol = 6;  // TCP
+        stream.insert(stream.end(), 400 - i * 15, flow);
+    }
+    for (int i = 0; i < 3000; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = rng();
+        flow.dst_ip = rng();
+        stream.push_back(flow);
+    }
+    std::shuffle(stream.begin(), stream.end(), rng);
+    tracked.insert_batch(stream.data(), stream.size());
+
+    const auto& sketch = tracked.sketch();
+    auto all = sketch.get_heavy_flows();
+    auto top = sketch.top_k(5);
+    ASSERT_EQ(top.size(), 5u);
+    for (size_t i = 0; i < top.size(); i++) {
+        EXPECT_EQ(top[i].count, all[i].count);
+        EXPECT_EQ(top[i].key.src_ip, 0x0A000000 + i);
+    }
+    EXPECT_EQ(sketch.top_k(all.size() + 10).size(), all.size());
+    EXPECT_TRUE(sketch.top_k(0).empty());
+
+    auto running = tracked.top_k();
+    ASSERT_EQ(running.size(), 5u);
+    for (size_t i = 0; i < running.size(); i++) {
+        EXPECT_EQ(running[i].key.src_ip, top[i].key.src_ip);
+        EXPECT_EQ(running[i].count, top[i].count);
+    }
+}
+
+TEST(VersionedSketchTest, ReadersSeeMonotonicCountsDuringIngestion) {
+    using TestSketch = jigsaw::VersionedSketch<jigsaw::IPv4Flow, 256, 104, 8, 8, jigsaw::SoALayout>;
+    auto sketch = std::make_unique<TestSketch>();
+    jigsaw::IPv4Flow elephant{};
+    elephant.src_ip = 0x0A000001;
+    elephant.protocol = 6;  // TCP
+
+    constexpr int rounds = 200;
+    std::mt19937 rng(23);
+    std::vector<jigsaw::IPv4Flow> batch(256);
+    std::atomic<bool> done{false};
+
+    std::thread reader([&] {
+        uint32_t last = 0;
+        while (!done.load(std::memory_order_acquire)) {
+            uint32_t count = sketch->query(elephant);
+            EXPECT_GE(count, last);
+            last = count;
+            for (const auto& flow : sketch->get_heavy_flows()) {
+                EXPECT_LE(flow.count, uint32_t(rounds));
+            }
+        }
+    });
+
+    for (int round = 0; round < rounds; round++) {
+        batch[0] = elephant;
+        for (size_t i = 1; i < batch.size(); i++) {
+            batch[i] = jigsaw::IPv4Flow{};
+            batch[i].src_ip = rng();
+        }
+        sketch->insert_batch(batch.data(), batch.size());
+        std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+    reader.join();
+
+    EXPECT_EQ(sketch->query(elephant), uint32_t(rounds));
+}
+
+TEST(EpochSketchTest, ExportsAreLosslessWhileIngesting) {
+    using TestSketch = jigsaw::EpochSketch<jigsaw::IPv4Flow, 1024, 104, 8, 8, jigsaw::SoALayout>;
+    auto sketch = std::make_unique<TestSketch>();
+    jigsaw::IPv4Flow elephant{};
+    elephant.src_ip = 0x0A000001;
+
+    constexpr int rounds = 2000;
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        std::mt19937 rng(29);
+        std::vector<jigsaw::IPv4Flow> batch(32);
+        for (int round = 0; round < rounds; round++) {
+            // Leading with the elephant keeps it in a heavy cell of every
+            // freshly cleared sketch, so its per-epoch counts are exact
+            batch[0] = elephant;
+            for (size_t i = 1; i < batch.size(); i++) {
+                batch[i] = jigsaw::IPv4Flow{};
+                batch[i].src_ip = rng();
+            }
+            sketch->insert_batch(batch.data(), batch.size());
+            if (round % 64 == 0) {
+                std::this_thread::yield();
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    uint64_t exported = 0;
+    auto collect = [&](const TestSketch::SketchType& retired) { exported += retired.query(elephant); };
+    while (!done.load(std::memory_order_acquire)) {
+        sketch->export_epoch(collect);
+        std::this_thread::yield();
+    }
+    writer.join();
+    sketch->export_epoch(collect);
+    sketch->export_epoch(collect);
+
+    EXPECT_EQ(exported, uint64_t(rounds));
+    EXPECT_GE(sketch->epoch(), 2u);
+
+    // Exported sketches come back empty
+    uint64_t leftover = 0;
+    sketch->export_epoch([&](const TestSketch::SketchType& retired) {
+        leftover += retired.get_heavy_flows().size() + retired.query(elephant);
+    });
+    EXPECT_EQ(leftover, 0u);
+
+    // Streaming clear of a table whose size and start are not line-aligned
+    auto plain = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 100, 79, 5, 3>>();
+    for (int i = 0; i < 50; i++) plain->insert(elephant);
+    plain->clear();
+    EXPECT_EQ(plain->query(elephant), 0u);
+    EXPECT_TRUE(plain->get_heavy_flows().empty());
+}
+
+TEST(ShardedSketchTest, WorkersInsertIntoOwnShards) {
+    constexpr size_t SHARD_NUM = 4;
+    jigsaw::ShardedSketch<jigsaw::IPv4Flow, 1024, 104, 8, 8> sketch(SHARD_NUM);
+
+    // Flow i is sent (i + 1) * 10 times
+    std::vector<std::vector<jigsaw::IPv4Flow>> partitions(SHARD_NUM);
+    for (uint32_t i = 0; i < 20; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = 0x0A000000 + i;
+        flow.dst_ip = 0x0B000001;
+        flow.src_port = 1000;
+        flow.dst_port = 80;
+        flow.protocol = 6;  // TCP
+        size_t shard = sketch.shard_of(flow);
+        ASSERT_LT(shard, SHARD_NUM);
+        partitions[shard].insert(partitions[shard].end(), (i + 1) * 10, flow);
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t shard = 0; shard < SHARD_NUM; shard++) {
+        workers.emplace_back([&, shard] {
+            const auto& flows = partitions[shard];
+            for (size_t i = 0; i < flows.size(); i += 16) {
+                sketch.insert_batch(shard, &flows[i], std::min<size_t>(16, flows.size() - i));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    auto flows = sketch.get_heavy_flows();
+    ASSERT_EQ(flows.size(), 20u);
+    for (size_t i = 0; i < flows.size(); i++) {
+        EXPECT_EQ(flows[i].count, (20 - i) * 10);
+    }
+    EXPECT_EQ(sketch.get_heavy_flows(5).size(), 5u);
+}
+
+TEST(ShardedSketchTest, BatchesForAnotherShardAssertInDebug) {
+    jigsaw::ShardedSketch<jigsaw::IPv4Flow, 64, 104, 4, 4> sketch(4);
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = 0x0A000001;
+    const size_t wrong_shard = (sketch.shard_of(flow) + 1) % sketch.shard_num();
+    EXPECT_DEBUG_DEATH(sketch.insert_batch(wrong_shard, &flow, 1), "another key's shard");
+}
+
+TEST(SketchSnapshotTest, DecodesTheCopiedState) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 256, 104, 4, 4>;
+    auto sketch = std::make_unique<TestSketch>(5);
+    for (uint32_t i = 0; i < 2000; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = i % 300;
+        flow.dst_ip = 0x0B000001;
+        sketch->insert(flow, 1 + i % 7);
+    }
+
+    const TestSketch::Snapshot snapshot = sketch->snapshot();
+    const auto expected = sketch->get_heavy_flows();
+    const auto expected_top = sketch->top_k(10);
+
+    // Later inserts do not reach the copy
+    jigsaw::IPv4Flow late{};
+    late.src_ip = 0xFFFF;
+    sketch->insert(late, 100000);
+
+    const auto flows = snapshot.get_heavy_flows();
+    ASSERT_EQ(flows.size(), expected.size());
+    for (size_t i = 0; i < flows.size(); i++) {
+        EXPECT_EQ(flows[i].count, expected[i].count);
+        EXPECT_EQ(memcmp(&flows[i].key, &expected[i].key, jigsaw::IPv4Flow::SIZE), 0);
+    }
+    const auto top = snapshot.top_k(10);
+    ASSERT_EQ(top.size(), expected_top.size());
+    for (size_t i = 0; i < top.size(); i++) {
+        EXPECT_EQ(top[i].count, expected_top[i].count);
+    }
+}
+
+TEST(ConcurrentSketchTest, ParallelProducersCountEveryPacket) {
+    constexpr int THREAD_NUM = 4;
+    constexpr uint32_t PER_THREAD = 1000;
+    auto sketch = std::make_unique<jigsaw::ConcurrentSketch<jigsaw::IPv4Flow, 1024, 104, 8, 8>>();
+
+    std::vector<jigsaw::IPv4Flow> flows;
+    for (uint32_t i = 0; i < 8; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = 0x0A000000 + i;
+        flow.dst_ip = 0x0B000001;
+        flow.src_port = 1000;
+        flow.dst_port = 80;
+        flow.protocol = 17;  // UDP
+        flows.push_back(flow);
+    }
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < THREAD_NUM; t++) {
+        producers.emplace_back([&] {
+            for (uint32_t i = 0; i < PER_THREAD; i++) {
+                for (const auto& flow : flows) {
+                    sketch->insert(flow);
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    for (const auto& flow : flows) {
+        EXPECT_GE(sketch->query(flow), THREAD_NUM * PER_THREAD);
+    }
+    auto heavy = sketch->get_heavy_flows();
+    ASSERT_EQ(heavy.size(), flows.size());
+    for (const auto& flow : heavy) {
+        EXPECT_EQ(flow.count, THREAD_NUM * PER_THREAD);
+    }
+}
+
+// Past 512 packets the slot's extra counter is set; it must not leak into
+// the decoded key, also when it straddles a word (LeftPartBits % 64 == 63)
+template<uint32_t LeftPartBits>
+void expect_concurrent_keys_match_sketch() {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, LeftPartBits, 8, 8>>();
+    auto concurrent = std::make_unique<jigsaw::ConcurrentSketch<jigsaw::IPv4Flow, 1024, LeftPartBits, 8, 8>>();
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = 0x0A000001;
+    flow.dst_ip = 0x0B000001;
+    flow.src_port = 1234;
+    flow.dst_port = 443;
+    flow.protocol = 6;
+    for (int i = 0; i < 600; i++) {
+        sketch->insert(flow);
+        concurrent->insert(flow);
+    }
+
+    auto expected = sketch->get_heavy_flows();
+    auto flows = concurrent->get_heavy_flows();
+    ASSERT_EQ(expected.size(), 1u);
+    ASSERT_EQ(flows.size(), 1u);
+    EXPECT_EQ(flows[0].count, expected[0].count);
+    EXPECT_EQ(memcmp(&flows[0].key, &expected[0].key, jigsaw::IPv4Flow::SIZE), 0) << LeftPartBits;
+    EXPECT_EQ(concurrent->query(flow), 600u);
+}
+
+TEST(ConcurrentSketchTest, HeavyFlowsMatchSketchPastVerification) {
+    expect_concurrent_keys_match_sketch<79>();
+    expect_concurrent_keys_match_sketch<104>();
+    expect_concurrent_keys_match_sketch<127>();
+}
+
+TEST(ConcurrentSketchTest, DumpsDuringChurnDecodeInsertedKeys) {
+    // Few cells for many flows, so heavy cells change hands constantly while
+    // a reader dumps them. IPv6 keys carry key bits in the fingerprint, so a
+    // cell paired with its previous occupant's left part would decode to a
+    // key nobody inserted.
+    using Hasher = jigsaw::KeyHasher<jigsaw::IPv6Flow, 4>;
+    auto sketch = std::make_unique<jigsaw::ConcurrentSketch<jigsaw::IPv6Flow, 4, Hasher::LEFT_PART_BITS, 2, 2>>();
+    auto flow_of = [](uint32_t id) {
+        jigsaw::IPv6Flow flow{};
+        flow.src_ip[0] = id;
+        flow.dst_ip[1] = 0x0B000001;
+        flow.src_port = static_cast<uint16_t>(id);
+        flow.dst_port = 80;
+        flow.protocol = 6;
+        return flow;
+    };
+    constexpr uint32_t FLOW_NUM = 256;
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> producers;
+    for (uint32_t t = 0; t < 2; t++) {
+        producers.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            for (int i = 0; i < 200000; i++) {
+                sketch->insert(flow_of(rng() % FLOW_NUM));
+            }
+        });
+    }
+    std::thread reader([&] {
+        while (!done.load()) {
+            for (const auto& flow : sketch->get_heavy_flows()) {
+                ASSERT_LT(flow.key.src_ip[0], FLOW_NUM);
+                ASSERT_EQ(flow.key.src_port, flow.key.src_ip[0]);
+                ASSERT_EQ(flow.key.dst_ip[1], 0x0B000001u);
+            }
+        }
+    });
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    done.store(true);
+    reader.join();
+}
+
+TEST(SketchMergeTest, MergedSketchMatchesCombinedStream) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 104, 8, 8>;
+    auto left = std::make_unique<TestSketch>();
+    auto right = std::make_unique<TestSketch>();
+    auto combined = std::make_unique<TestSketch>();
+
+    std::vector<jigsaw::IPv4Flow> flows;
+    for (uint32_t i = 0; i < 200; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = 0x0A000000 + i;
+        flow.dst_ip = 0x0B000001;
+        flow.src_port = 1000;
+        flow.dst_port = 80;
+        flow.protocol = 6;  // TCP
+        flows.push_back(flow);
+    }
+
+    // Overlapping halves of the flow set seen by two collectors
+    for (uint32_t i = 0; i < flows.size(); i++) {
+        for (uint32_t n = 0; n <= i % 7; n++) {
+            if (i < 150) left->insert(flows[i]);
+            if (i >= 50) right->insert(flows[i]);
+            if (i < 150) combined->insert(flows[i]);
+            if (i >= 50) combined->insert(flows[i]);
+        }
+    }
+
+    left->merge(*right);
+    for (const auto& flow : flows) {
+        EXPECT_EQ(left->query(flow), combined->query(flow));
+    }
+    EXPECT_EQ(left->get_heavy_flows().size(), combined->get_heavy_flows().size());
+}
+
+TEST(SketchMergeTest, ParallelMergeMatchesSequential) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8>;
+    auto a = std::make_unique<TestSketch>();
+    auto b = std::make_unique<TestSketch>();
+    auto sequential = std::make_unique<TestSketch>();
+    auto parallel = std::make_unique<TestSketch>();
+
+    std::mt19937 rng(1);
+    std::vector<jigsaw::IPv4Flow> flows(50000);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng() % 5000;
+        flow.dst_ip = 0x0B000001;
+        flow.protocol = 6;  // TCP
+    }
+    a->insert_batch(flows.data(), 25000);
+    b->insert_batch(flows.data() + 25000, 25000);
+
+    sequential->merge(*a);
+    sequential->merge(*b);
+    parallel->merge_parallel(*a, 3);
+    parallel->merge_parallel(*b, 3);
+
+    auto expected = sequential->get_heavy_flows();
+    auto actual = parallel->get_heavy_flows();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        EXPECT_EQ(actual[i].count, expected[i].count);
+    }
+}
+
+TEST(SketchSerializationTest, RoundTripPreservesState) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8, jigsaw::SoALayout>;
+    auto original = std::make_unique<TestSketch>();
+    auto restored = std::make_unique<TestSketch>();
+
+    std::mt19937 rng(7);
+    std::vector<jigsaw::IPv4Flow> flows(20000);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng() % 3000;
+        flow.dst_ip = 0x0B000001;
+        flow.protocol = 17;  // UDP
+    }
+    original->insert_batch(flows.data(), flows.size());
+
+    std::stringstream stream;
+    original->serialize(stream);
+    EXPECT_EQ(stream.str().size(), TestSketch::SERIALIZED_SIZE);
+    restored->deserialize(stream);
+
+    for (size_t i = 0; i < 1000; i++) {
+        EXPECT_EQ(restored->query(flows[i]), original->query(flows[i]));
+    }
+    EXPECT_EQ(restored->get_heavy_flows().size(), original->get_heavy_flows().size());
+
+    // A different configuration must refuse the bytes
+    std::stringstream again(stream.str());
+    auto other = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8>>();
+    EXPECT_THROW(other->deserialize(again), std::runtime_error);
+}
+
+TEST(SketchSerializationTest, TruncatedStreamLeavesSketchUntouched) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 79, 8, 8>;
+    auto source = std::make_unique<TestSketch>(1);
+    auto target = std::make_unique<TestSketch>(2);
+
+    std::vector<jigsaw::IPv4Flow> flows(2000);
+    for (uint32_t i = 0; i < flows.size(); i++) {
+        flows[i] = jigsaw::IPv4Flow{};
+        flows[i].src_ip = i;
+        flows[i].dst_ip = 0x0B000001;
+        source->insert(flows[i], 1 + i % 5);
+        target->insert(flows[i], 1 + i % 3);
+    }
+    std::vector<uint32_t> before(flows.size());
+    target->query_batch(flows.data(), flows.size(), before.data());
+
+    std::stringstream stream;
+    source->serialize(stream);
+    const std::string bytes = stream.str();
+
+    // Cut inside the buckets and inside the auxiliary list
+    for (size_t size : {sizeof(jigsaw::SketchFileHeader) + 100, bytes.size() / 2, bytes.size() - 8}) {
+        std::stringstream truncated(bytes.substr(0, size));
+        EXPECT_THROW(target->deserialize(truncated), std::runtime_error) << size;
+        std::vector<uint32_t> after(flows.size());
+        target->query_batch(flows.data(), flows.size(), after.data());
+        EXPECT_EQ(after, before) << size;
+    }
+
+    std::stringstream whole(bytes);
+    target->deserialize(whole);
+    for (const auto& flow : flows) {
+        EXPECT_EQ(target->query(flow), source->query(flow));
+    }
+}
+
+TEST(SketchSerializationTest, MappedViewAnswersFromFile) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 104, 8, 8>;
+    auto sketch = std::make_unique<TestSketch>();
+
+    std::vector<jigsaw::IPv4Flow> flows;
+    for (uint32_t i = 0; i < 300; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = 0x0A000000 + i;
+        flow.dst_ip = 0x0B000001;
+        flow.src_port = 1000;
+        flow.dst_port = 53;
+        flow.protocol = 17;  // UDP
+        flows.push_back(flow);
+        for (uint32_t n = 0; n <= i % 5; n++) {
+            sketch->insert(flow);
+        }
+    }
+
+    std::string path = ::testing::TempDir() + "jigsaw_view_test.bin";
+    sketch->save(path);
+    {
+        auto view = TestSketch::view(path);
+        for (const auto& flow : flows) {
+            EXPECT_EQ(view.query(flow), sketch->query(flow));
+        }
+        auto expected = sketch->get_heavy_flows();
+        auto actual = view.get_heavy_flows();
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); i++) {
+            EXPECT_EQ(actual[i].count, expected[i].count);
+        }
+    }
+
+    using OtherSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 2048, 104, 8, 8>;
+    EXPECT_THROW(OtherSketch::View view(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(TraceReaderTest, ReplayDecodesEveryRecordInOrder) {
+    // Two trace files of packed 13-byte records, with odd counts so both
+    // vector and scalar decoding run
+    std::mt19937 rng(21);
+    std::vector<jigsaw::IPv4Flow> expected;
+    std::vector<std::string> paths;
+    for (size_t file : {0, 1}) {
+        std::string path = ::testing::TempDir() + "jigsaw_trace_" + std::to_string(file) + ".dat";
+        FILE* out = fopen(path.c_str(), "wb");
+        ASSERT_NE(out, nullptr);
+        for (size_t i = 0; i < 1001 + 2 * file; i++) {
+            jigsaw::IPv4Flow flow{};
+            flow.src_ip = rng();
+            flow.dst_ip = rng();
+            flow.src_port = static_cast<uint16_t>(rng());
+            flow.dst_port = static_cast<uint16_t>(rng());
+            flow.protocol = static_cast<uint8_t>(rng());
+            uint8_t record[jigsaw::TRACE_RECORD_SIZE];
+            memcpy(record, &flow.src_ip, 4);
+            memcpy(record + 4, &flow.src_port, 2);
+            memcpy(record + 6, &flow.dst_ip, 4);
+            memcpy(record + 10, &flow.dst_port, 2);
+            record[12] = flow.protocol;
+            fwrite(record, 1, sizeof(record), out);
+            expected.push_back(flow);
+        }
+        fclose(out);
+        paths.push_back(path);
+    }
+
+    std::vector<jigsaw::IPv4Flow> replayed;
+    size_t n = jigsaw::replay_traces(paths, [&](const jigsaw::IPv4Flow* flows, size_t count) {
+        replayed.insert(replayed.end(), flows, flows + count);
+    }, 64);
+    ASSERT_EQ(n, expected.size());
+    ASSERT_EQ(replayed.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        // Padding is zeroed, so whole structs compare equal
+        EXPECT_EQ(memcmp(&replayed[i], &expected[i], sizeof(jigsaw::IPv4Flow)), 0) << "record " << i;
+    }
+
+    EXPECT_EQ(jigsaw::replay_traces(paths, [](const jigsaw::IPv4Flow*, size_t) {}, 100, 1500), 1500u);
+    EXPECT_THROW(jigsaw::replay_traces({::testing::TempDir() + "jigsaw_missing.dat"},
+                                       [](const jigsaw::IPv4Flow*, size_t) {}),
+                 std::system_error);
+    for (const auto& path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+TEST(TokenizerTest, KeysMatchScalarSplit) {
+    // Random text with every whitespace kind, runs of it, mixed case,
+    // non-letters and bytes >= 0x80, at lengths around block boundaries
+    std::mt19937 rng(23);
+    const char spaces[] = {' ', '\n', '\t', '\r'};
+    auto is_space = [](char c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r'; };
+    for (size_t size : {0, 1, 15, 63, 64, 65, 128, 1000, 4097}) {
+        for (bool leading_space : {false, true}) {
+            std::string text;
+            while (text.size() < size) {
+                if (leading_space || !text.empty()) {
+                    text.append(1 + rng() % 3, spaces[rng() % 4]);
+                }
+                size_t length = rng() % 8 == 0 ? 1 + rng() % 100 : 1 + rng() % 14;
+                for (size_t i = 0; i < length; i++) {
+                    text += static_cast<char>(rng() % 4 == 0 ? rng() % 256 : 'A' + rng() % 58);
+                }
+            }
+            text.resize(size);
+
+            std::vector<jigsaw::CompactStringKey> expected;
+            for (size_t i = 0; i < text.size();) {
+                if (is_space(text[i])) {
+                    i++;
+                    continue;
+                }
+                size_t begin = i;
+                while (i < text.size() && !is_space(text[i])) {
+                    i++;
+                }
+                expected.emplace_back(std::string_view(text).substr(begin, i - begin));
+            }
+
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+            std::vector<jigsaw::CompactStringKey> keys;
+            size_t n = jigsaw::tokenize_words(bytes, text.size(), [&](const jigsaw::CompactStringKey* batch, size_t count) {
+                keys.insert(keys.end(), batch, batch + count);
+            }, 7);
+            ASSERT_EQ(n, expected.size()) << "size " << size;
+            ASSERT_EQ(keys.size(), expected.size());
+            for (size_t i = 0; i < keys.size(); i++) {
+                EXPECT_EQ(keys[i].data, expected[i].data) << "size " << size << " word " << i;
+                EXPECT_EQ(keys[i].length, expected[i].length) << "size " << size << " word " << i;
+            }
+
+            // Splitting across threads yields the same words, part by part
+            for (size_t thread_num : {1, 3, 8}) {
+                std::vector<std::vector<jigsaw::CompactStringKey>> parts(thread_num);
+                size_t total = jigsaw::tokenize_words_parallel(bytes, text.size(), thread_num,
+                    [&](size_t part, const jigsaw::CompactStringKey* batch, size_t count) {
+                        parts[part].insert(parts[part].end(), batch, batch + count);
+                    }, 5);
+                ASSERT_EQ(total, expected.size());
+                size_t i = 0;
+                for (const auto& part : parts) {
+                    for (const auto& key : part) {
+                        ASSERT_LT(i, expected.size());
+                        EXPECT_EQ(key.data, expected[i].data);
+                        EXPECT_EQ(key.length, expected[i].length);
+                        i++;
+                    }
+                }
+                EXPECT_EQ(i, expected.size());
+            }
+        }
+    }
+}
+
+TEST(DynamicSketchTest, MatchesStaticSketch) {
+    using StaticSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 104, 8, 8>;
+    auto fixed = std::make_unique<StaticSketch>();
+    jigsaw::DynamicSketch<jigsaw::IPv4Flow> dynamic({1024, 104, 8, 8, false});
+
+    std::vector<jigsaw::IPv4Flow> flows;
+    for (uint32_t i = 0; i < 500; i++) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = 0x0A000000 + i;
+        flow.dst_ip = 0x0B000001;
+        flow.src_port = 1000;
+        flow.dst_port = 443;
+        flow.protocol = 6;  // TCP
+        flows.push_back(flow);
+        for (uint32_t n = 0; n <= i % 9; n++) {
+            fixed->insert(flow);
+            dynamic.insert(flow);
+        }
+    }
+
+    for (const auto& flow : flows) {
+        EXPECT_EQ(dynamic.query(flow), fixed->query(flow));
+    }
+    EXPECT_EQ(dynamic.get_heavy_flows().size(), fixed->get_heavy_flows().size());
+}
+
+TEST(DynamicSketchTest, OddCellCountsAndHugePages) {
+    // Cell counts that do not fill a SIMD chunk exercise the padding lanes
+    jigsaw::DynamicSketch<jigsaw::IPv4Flow> sketch({1000, 79, 5, 19, true});
+
+    std::mt19937 rng(3);
+    std::vector<jigsaw::IPv4Flow> flows(2000);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng();
+        flow.dst_ip = rng();
+        flow.protocol = 17;  // UDP
+    }
+    for (int round = 0; round < 3; round++) {
+        sketch.insert_batch(flows.data(), flows.size());
+    }
+
+    // Two flows per bucket on average fit without evictions; only the odd
+    // fingerprint collision within a bucket may be off
+    size_t exact = 0;
+    for (const auto& flow : flows) {
+        exact += sketch.query(flow) == 3u;
+    }
+    EXPECT_GE(exact, flows.size() * 99 / 100);
+    auto heavy = sketch.get_heavy_flows();
+    EXPECT_LE(heavy.size(), 5000u);
+    EXPECT_GT(heavy.size(), 0u);
+
+    EXPECT_THROW(jigsaw::DynamicSketch<jigsaw::IPv4Flow>({0, 79, 8, 8, false}), std::invalid_argument);
+    EXPECT_THROW(jigsaw::DynamicSketch<jigsaw::IPv4Flow>({16, 127, 8, 8, false}), std::invalid_argument);
+}
+
+TEST(FastRangeTest, ReductionsMatchModuloAndStayInRange) {
+    std::mt19937 rng(11);
+    for (uint32_t divisor : {1u, 3u, 1000u, 1024u, 16384u, 100000u, 0x7FFFFFFFu, 0xFFFFFFFFu}) {
+        jigsaw::FastMod fastmod(divisor);
+        for (int i = 0; i < 10000; i++) {
+            uint32_t value = rng();
+            EXPECT_EQ(fastmod(value), value % divisor);
+        }
+        EXPECT_EQ(fastmod(0xFFFFFFFFu), 0xFFFFFFFFu % divisor);
+    }
+
+    std::vector<uint32_t> hits(1000, 0);
+    for (int i = 0; i < 100000; i++) {
+        uint32_t value = rng() & 0x3FFFFFF;  // 26-bit, like the IPv4 key hash
+        EXPECT_EQ(jigsaw::reduce_range<16384>(value), value % 16384);
+        hits[jigsaw::reduce_range<1000>(value)]++;
+    }
+    // Every bucket is reachable and none is grossly over-subscribed
+    EXPECT_GT(*std::min_element(hits.begin(), hits.end()), 50u);
+    EXPECT_LT(*std::max_element(hits.begin(), hits.end()), 150u);
+}
+
+TEST(SketchRngTest, SeededSketchesAreReproducible) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 64, 104, 4, 4>;
+    auto first = std::make_unique<TestSketch>(1234);
+    auto second = std::make_unique<TestSketch>(1234);
+
+    // Far more flows than cells, so most inserts take the replacement path
+    std::mt19937 rng(5);
+    std::vector<jigsaw::IPv4Flow> flows(20000);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng() % 4000;
+        flow.protocol = 6;  // TCP
+    }
+    first->insert_batch(flows.data(), flows.size());
+    second->insert_batch(flows.data(), flows.size());
+
+    auto expected = first->get_heavy_flows();
+    auto actual = second->get_heavy_flows();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        EXPECT_EQ(actual[i].count, expected[i].count);
+        EXPECT_EQ(actual[i].key.src_ip, expected[i].key.src_ip);
+    }
+
+    // The division-free test accepts about 1 in n draws
+    jigsaw::WyRand generator(99);
+    uint32_t accepted = 0;
+    for (int i = 0; i < 100000; i++) {
+        accepted += jigsaw::one_in(static_cast<uint32_t>(generator()), 100);
+    }
+    EXPECT_NEAR(accepted, 1000, 150);
+}
+
+TEST(WeightedInsertTest, UnitWeightsMatchPlainInsert) {
+    using TestSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 64, 104, 4, 4>;
+    auto plain = std::make_unique<TestSketch>(77);
+    auto weighted = std::make_unique<TestSketch>(77);
+
+    // Contended enough to take every branch, replacements included
+    std::mt19937 rng(6);
+    std::vector<jigsaw::IPv4Flow> flows(20000);
+    for (auto& flow : flows) {
+        flow = jigsaw::IPv4Flow{};
+        flow.src_ip = rng() % 600 < 500 ? rng() % 40 : rng() % 4000;
+        flow.protocol = 17;
+    }
+    const std::vector<uint32_t> ones(flows.size(), 1);
+    plain->insert_batch(flows.data(), flows.size());
+    for (size_t i = 0; i < flows.size() / 2; i++) {
+        weighted->insert(flows[i], 1);
+    }
+    weighted->insert_batch(flows.data() + flows.size() / 2, ones.data(), flows.size() - flows.size() / 2);
+
+    auto expected = plain->get_heavy_flows();
+    auto actual = weighted->get_heavy_flows();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        EXPECT_EQ(actual[i].count, expected[i].count);
+        EXPECT_EQ(actual[i].key.src_ip, expected[i].key.src_ip);
+    }
+}
+
+TEST(WeightedInsertTest, CountsBytesOfHeavyFlows) {
+    auto sketch = std::make_unique<jigsaw::Sketch<jigsaw::IPv4Flow, 1024, 104, 8, 8>>(8);
+    std::mt19937 rng(9);
+    auto flow_of = [](uint32_t id) {
+        jigsaw::IPv4Flow flow{};
+        flow.src_ip = id;
+        flow.dst_ip = 0x0A000001;
+        flow.protocol = 6;
+        return flow;
+    };
+
+    // 20 bulk flows of 1500-byte packets among 200000 small-packet mice
+    std::vector<uint64_t> heavy_bytes(20, 0);
+    for (int round = 0; round < 500; round++) {
+        for (uint32_t id = 0; id < 20; id++) {
+            const uint32_t bytes = id % 2 ? 1500 : 40 + rng() % 1461;
+            EXPECT_GT(sketch->insert(flow_of(id), bytes), 0u);
+            heavy_bytes[id] += bytes;
+        }
+        for (int i = 0; i < 400; i++) {
+            sketch->insert(flow_of(1000 + rng() % 200000), 40 + rng() % 80);
+        }
+    }
+
+    for (uint32_t id = 0; id < 20; id++) {
+        EXPECT_NEAR(double(sketch->query(flow_of(id))), double(heavy_bytes[id]), heavy_bytes[id] * 0.01) << id;
+    }
+    auto top = sketch->top_k(20);
+    ASSERT_EQ(top.size(), 20u);
+    for (const auto& flow : top) {
+        EXPECT_LT(flow.key.src_ip, 20u);
+    }
+
+    // Counters saturate instead of wrapping
+    const jigsaw::IPv4Flow big = flow_of(500000);
+    sketch->insert(big, UINT32_MAX - 10);
+    EXPECT_EQ(sketch->insert(big, 100), UINT32_MAX);
+}
+
+TEST(WeightedInsertTest, PackedCountersSaturateAtCountMax) {
+    using PackedSketch = jigsaw::Sketch<jigsaw::IPv4Flow, 64, 104, 4, 4, jigsaw::PackedLayout<>>;
+    constexpr uint32_t COUNT_MAX = (1u << 18) - 1;
+    auto sketch = std::make_unique<PackedSketch>(3);
+    jigsaw::IPv4Flow flow{};
+    flow.src_ip = 1;
+
+    // A first insert heavier than the counter reports the stored count
+    EXPECT_EQ(sketch->insert(flow, 300000), COUNT_MAX);
+    EXPECT_EQ(sketch->insert(flow, 1500), COUNT_MAX);
+    EXPECT_EQ(sketch->query(flow), COUNT_MAX);
+}
+
+// Writes random slots through the codec and checks every slot against a
+// plain copy, so a store that spills into a neighbour is caught
+template<uint32_t LeftPartBits, bool Padded>
+void check_slot_codec() {
+    using Codec = jigsaw::auxiliary::SlotCodec<LeftPartBits, Padded>;
+    constexpr uint32_t WORDS = Codec::LEFT_PART_WORDS;
+    constexpr uint64_t SLOT_NUM = 257;
+    std::vector<uint64_t> words(Codec::word_num(SLOT_NUM), 0);
+    std::vector<std::array<uint64_t, WORDS>> expected_parts(SLOT_NUM, std::array<uint64_t, WORDS>{});
+    std::vector<uint8_t> expected_counters(SLOT_NUM, 0);
+    auto word_mask = [](uint32_t w) {
+        uint32_t lo = w * 64;
+        return lo >= LeftPartBits ? 0 : LeftPartBits - lo >= 64 ? ~0ULL : (1ULL << (LeftPartBits - lo)) - 1;
+    };
+
+    std::mt19937_64 rng(LeftPartBits);
+    for (int round = 0; round < 2000; round++) {
+        uint64_t slot = rng() % SLOT_NUM;
+        uint64_t left_part[WORDS];
+        for (uint32_t w = 0; w < WORDS; w++) {
+            left_part[w] = rng();
+            expected_parts[slot][w] = left_part[w] & word_mask(w);
+        }
+        uint8_t counter = rng() & 3;
+        Codec::set_left_part(words.data(), slot, left_part);
+        Codec::set_extra_counter(words.data(), slot, counter);
+        expected_counters[slot] = counter;
+    }
+
+    for (uint64_t slot = 0; slot < SLOT_NUM; slot++) {
+        uint64_t left_part[WORDS];
+        EXPECT_EQ(Codec::get_left_part(words.data(), slot, left_part), expected_counters[slot]);
+        for (uint32_t w = 0; w < WORDS; w++) {
+            EXPECT_EQ(left_part[w], expected_parts[slot][w]);
+        }
+        EXPECT_TRUE(jigsaw::auxiliary::same_left_part(left_part, expected_parts[slot].data(), LeftPartBits));
+        if constexpr (!Padded && !Codec::WIDE) {
+            uint64_t runtime_part[2];
+            EXPECT_EQ(jigsaw::auxiliary::get_left_part(words.data(), LeftPartBits, slot, runtime_part),
+                      expected_counters[slot]);
+            EXPECT_TRUE(jigsaw::auxiliary::same_left_part(runtime_part, left_part, LeftPartBits));
+        }
+    }
+
+    // Clearing a slot leaves its neighbours alone
+    Codec::clear_slot(words.data(), 100);
+    uint64_t left_part[WORDS];
+    EXPECT_EQ(Codec::get_left_part(words.data(), 100, left_part), 0);
+    EXPECT_EQ(left_part[0], 0u);
+    EXPECT_EQ(Codec::get_left_part(words.data(), 101, left_part), expected_counters[101]);
+    EXPECT_EQ(left_part[WORDS - 1], expected_parts[101][WORDS - 1]);
+}
+
+TEST(AuxiliaryListTest, SlotCodecRoundTrips) {
+    check_slot_codec<26, false>();
+    check_slot_codec<62, false>();
+    check_slot_codec<79, false>();
+    check_slot_codec<104, false>();
+    check_slot_codec<126, false>();
+    check_slot_codec<26, true>();
+    check_slot_codec<79, true>();
+    check_slot_codec<104, true>();
+    check_slot_codec<126, true>();
+    check_slot_codec<200, false>();
+    check_slot_codec<270, false>();
+    check_slot_codec<270, true>();
+}
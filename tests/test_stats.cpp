@@ -0,0 +1,90 @@
+// Built with JIGSAW_ENABLE_STATS (see CMakeLists.txt), apart from
+// sketch_test, so both instrumented and plain Sketch are covered
+#include <gtest/gtest.h>
+#include <jigsaw/sketch.hpp>
+#include <type_traits>
+
+static_assert(jigsaw::STATS_ENABLED, "sketch_stats_test must be built with JIGSAW_ENABLE_STATS");
+static_assert(std::is_empty_v<jigsaw::StatsRecorder<false>>, "disabled stats must not take space");
+
+namespace {
+
+jigsaw::IPv4Flow flow(uint32_t id) {
+    jigsaw::IPv4Flow key{};
+    key.src_ip = 0x0A000000 + id;
+    key.dst_ip = 0xC0A80001;
+    key.src_port = static_cast<uint16_t>(1000 + id);
+    key.dst_port = 80;
+    key.protocol = 6;
+    return key;
+}
+
+} // namespace
+
+TEST(SketchStatsTest, CountsEveryUpdateBranch) {
+    // One bucket of two heavy and two light cells, so every branch is
+    // reachable with a handful of flows
+    jigsaw::Sketch<jigsaw::IPv4Flow, 1, 104, 2, 2> sketch(7);
+
+    sketch.insert(flow(0));  // heavy cells fill
+    sketch.insert(flow(1));
+    sketch.insert(flow(2));  // then light cells
+    sketch.insert(flow(3));
+    sketch.insert(flow(0));  // heavy match
+    sketch.insert(flow(2));  // light match at 2 >= smallest heavy 1: promoted
+    sketch.insert(flow(3));  // light match at 2 < smallest heavy 2: stays
+
+    auto stats = sketch.stats();
+    EXPECT_EQ(stats.inserts, 7u);
+    EXPECT_EQ(stats.empty_fills, 4u);
+    EXPECT_EQ(stats.heavy_matches, 1u);
+    EXPECT_EQ(stats.light_matches, 2u);
+    EXPECT_EQ(stats.promotions, 1u);
+    EXPECT_EQ(stats.verifications, 0u);
+
+    // flow(0) reaches 512 packets: one left part check, which agrees
+    for (int i = 2; i < 512; i++) {
+        sketch.insert(flow(0));
+    }
+    stats = sketch.stats();
+    EXPECT_EQ(stats.heavy_matches, 511u);
+    EXPECT_EQ(stats.verifications, 1u);
+    EXPECT_EQ(stats.extra_increments, 1u);
+    EXPECT_EQ(stats.extra_decrements + stats.left_part_rewrites, 0u);
+
+    // New flows find the bucket full and contend for the smallest cell
+    for (uint32_t id = 100; id < 120; id++) {
+        sketch.insert(flow(id));
+    }
+    stats = sketch.stats();
+    EXPECT_EQ(stats.replacements + stats.replacements_rejected, 20u);
+    EXPECT_GT(stats.replacements, 0u);
+    EXPECT_EQ(stats.inserts, 7u + 510u + 20u);
+    EXPECT_EQ(stats.queries, 0u);
+
+    EXPECT_EQ(sketch.query(flow(0)), 512u);
+    uint32_t counts[2];
+    const jigsaw::IPv4Flow keys[2] = {flow(2), flow(3)};
+    sketch.query_batch(keys, 2, counts);
+    EXPECT_EQ(sketch.stats().queries, 3u);
+
+    sketch.reset_stats();
+    stats = sketch.stats();
+    EXPECT_EQ(stats.inserts, 0u);
+    EXPECT_EQ(stats.queries, 0u);
+    EXPECT_EQ(stats.heavy_matches, 0u);
+}
+
+TEST(SketchStatsTest, WeightedInsertsVerifyOnCrossing) {
+    jigsaw::Sketch<jigsaw::IPv4Flow, 1, 104, 2, 2> sketch(9);
+
+    sketch.insert(flow(0), 300);
+    EXPECT_EQ(sketch.insert(flow(0), 300), 600u);  // crosses 512 without hitting it
+    EXPECT_EQ(sketch.stats().verifications, 1u);
+    EXPECT_EQ(sketch.stats().extra_increments, 1u);
+
+    // Past 512, a weight of 512 or more is always verified
+    sketch.insert(flow(0), 1500);
+    EXPECT_EQ(sketch.stats().verifications, 2u);
+    EXPECT_EQ(sketch.query(flow(0)), 2100u);
+}